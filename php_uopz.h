@@ -0,0 +1,50 @@
+/*
+  +----------------------------------------------------------------------+
+  | uopz                                                                 |
+  +----------------------------------------------------------------------+
+  | Copyright (c) Joe Watkins 2016-2020                                  |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 3.01 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.php.net/license/3_01.txt                                  |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Joe Watkins <krakjoe@php.net>                                |
+  +----------------------------------------------------------------------+
+ */
+
+#ifndef PHP_UOPZ_H
+#define PHP_UOPZ_H
+
+/* the API uopz exports to other extensions, installed with the PHP headers */
+
+#include "Zend/zend_execute.h"
+
+#ifdef PHP_WIN32
+#	ifdef UOPZ_EXPORTS
+#		define PHP_UOPZ_API __declspec(dllexport)
+#	else
+#		define PHP_UOPZ_API __declspec(dllimport)
+#	endif
+#elif defined(__GNUC__) && __GNUC__ >= 4
+#	define PHP_UOPZ_API __attribute__ ((visibility("default")))
+#else
+#	define PHP_UOPZ_API
+#endif
+
+/* installs handler for opcode after uopz, returns the handler it displaced for the caller to dispatch to */
+PHP_UOPZ_API user_opcode_handler_t uopz_handler_register(zend_uchar opcode, user_opcode_handler_t handler);
+
+#endif	/* PHP_UOPZ_H */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
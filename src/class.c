@@ -35,14 +35,25 @@ ZEND_EXTERN_MODULE_GLOBALS(uopz);
 #	define uopz_set_scope(s) EG(scope) = (s)
 #endif
 
-void uopz_set_mock(zend_string *clazz, zval *mock) { /* {{{ */
+void uopz_set_mock(zend_string *clazz, zval *mock, zend_bool statics) { /* {{{ */
 	zend_string *key = zend_string_tolower(clazz);
+	uopz_mock_t umock;
 
-	if (zend_hash_update(&UOPZ(mocks), key, mock)) {
-		zval_copy_ctor(mock);
+	ZVAL_COPY(&umock.target, mock);
+	umock.ce = NULL;
+	umock.statics = statics;
+
+	/* once set, static references re-resolve their class after every change */
+	if (statics) {
+		UOPZ(statics) = 1;
 	}
 
-	/*zend_string_release(key);*/
+	zend_hash_update_mem(&UOPZ(mocks), key, &umock, sizeof(uopz_mock_t));
+
+	uopz_mock_cache_flush();
+	uopz_generation_bump();
+
+	zend_string_release(key);
 } /* }}} */
 
 void uopz_unset_mock(zend_string *clazz) { /* {{{ */
@@ -52,49 +63,87 @@ void uopz_unset_mock(zend_string *clazz) { /* {{{ */
 		uopz_exception(
 			"the class provided (%s) has no mock set",
 			ZSTR_VAL(clazz));
-		/*zend_string_release(key);*/
+		zend_string_release(key);
 		return;
 	}
 
 	zend_hash_del(&UOPZ(mocks), key);
-	/*zend_string_release(key);*/
+	zend_string_release(key);
+
+	uopz_mock_cache_flush();
+	uopz_generation_release();
 } /* }}} */
 
 int uopz_get_mock(zend_string *clazz, zval *return_value) { /* {{{ */
-	zval *mock = NULL;
-	zend_string *key = zend_string_tolower(clazz);
+	uopz_mock_t *mock = uopz_find_mock(clazz);
 	
-	if (!(mock = zend_hash_find(&UOPZ(mocks), key))) {
-		/*zend_string_release(key);*/
+	if (!mock) {
 		return FAILURE;
 	}
 
-	ZVAL_COPY(return_value, mock);
-	/*zend_string_release(key);*/
+	ZVAL_COPY(return_value, &mock->target);
 
 	return SUCCESS;
 } /* }}} */
 
-int uopz_find_mock(zend_string *clazz, zend_object **object, zend_class_entry **mock) { /* {{{ */
-	zend_string *key = zend_string_tolower(clazz);
-	zval *found = zend_hash_find(&UOPZ(mocks), key);
-
-	/*zend_string_release(key);*/
+uopz_mock_t* uopz_find_mock(zend_string *clazz) { /* {{{ */
+	zval *found = uopz_hash_find_lc(&UOPZ(mocks), clazz);
 
 	if (!found) {
-		return FAILURE;
+		return NULL;
 	}
 
-	if (Z_TYPE_P(found) == IS_STRING) {
-		*mock = zend_lookup_class(Z_STR_P(found));
-	} else {
-		*mock = Z_OBJCE_P(found);
+	return Z_PTR_P(found);
+} /* }}} */
+
+uopz_mock_t* uopz_find_mock_lc(zend_string *key) { /* {{{ */
+	return zend_hash_find_ptr(&UOPZ(mocks), key);
+} /* }}} */
+
+/* {{{ the answer for a class entry only changes with the mocks, misses are remembered too */
+uopz_mock_t* uopz_find_mock_ce(zend_class_entry *ce) {
+	uopz_mock_t *mock;
+	zval *cached;
+
+	if ((cached = zend_hash_index_find(&UOPZ(mcache), (zend_ulong) ce))) {
+		return Z_PTR_P(cached);
+	}
+
+	mock = uopz_find_mock(ce->name);
+
+	zend_hash_index_add_new_ptr(
+		&UOPZ(mcache), (zend_ulong) ce, mock);
+
+	return mock;
+} /* }}} */
+
+/* {{{ a class named by the mock is looked up once */
+zend_class_entry* uopz_mock_class(uopz_mock_t *mock, zend_object **object) {
+	if (Z_TYPE(mock->target) == IS_OBJECT) {
 		if (object) {
-			*object = Z_OBJ_P(found);
+			*object = Z_OBJ(mock->target);
 		}
+
+		return Z_OBJCE(mock->target);
 	}
 
-	return SUCCESS;
+	if (!mock->ce) {
+		mock->ce = zend_fetch_class_by_name(
+			Z_STR(mock->target), NULL, ZEND_FETCH_CLASS_DEFAULT | ZEND_FETCH_CLASS_EXCEPTION);
+	}
+
+	return mock->ce;
+} /* }}} */
+
+void uopz_mock_cache_flush(void) { /* {{{ */
+	zend_hash_clean(&UOPZ(mcache));
+} /* }}} */
+
+void uopz_mock_free(zval *zv) { /* {{{ */
+	uopz_mock_t *mock = Z_PTR_P(zv);
+
+	zval_ptr_dtor(&mock->target);
+	efree(mock);
 } /* }}} */
 
 /* {{{ */
@@ -188,6 +237,9 @@ zend_bool uopz_extend(zend_class_entry *clazz, zend_class_entry *parent) {
 	if (is_final)
 		clazz->ce_flags |= ZEND_ACC_FINAL;
 
+	uopz_dirty(&clazz->function_table);
+	uopz_generation_bump();
+
 	return is_trait ? 1 : instanceof_function(clazz, parent);
 } /* }}} */
 
@@ -220,6 +272,9 @@ zend_bool uopz_implement(zend_class_entry *clazz, zend_class_entry *interface) {
 
 	zend_do_implement_interface(clazz, interface);
 
+	uopz_dirty(&clazz->function_table);
+	uopz_generation_bump();
+
 #if PHP_VERSION_ID >= 80000
 	clazz->ce_flags |= ZEND_ACC_RESOLVED_INTERFACES;
 #endif
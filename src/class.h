@@ -19,13 +19,24 @@
 #ifndef UOPZ_CLASS_H
 #define UOPZ_CLASS_H
 
-void uopz_set_mock(zend_string *clazz, zval *mock);
+typedef struct _uopz_mock_t {
+	zval target;
+	zend_class_entry *ce;
+	zend_bool statics;
+} uopz_mock_t;
+
+void uopz_set_mock(zend_string *clazz, zval *mock, zend_bool statics);
 void uopz_unset_mock(zend_string *clazz);
 
 zend_bool uopz_extend(zend_class_entry *clazz, zend_class_entry *parent);
 zend_bool uopz_implement(zend_class_entry *clazz, zend_class_entry *interface);
 int uopz_get_mock(zend_string *clazz, zval *return_value);
-int uopz_find_mock(zend_string *clazz, zend_object **object, zend_class_entry **mock);
+uopz_mock_t* uopz_find_mock(zend_string *clazz);
+uopz_mock_t* uopz_find_mock_lc(zend_string *key);
+uopz_mock_t* uopz_find_mock_ce(zend_class_entry *ce);
+zend_class_entry* uopz_mock_class(uopz_mock_t *mock, zend_object **object);
+void uopz_mock_cache_flush(void);
+void uopz_mock_free(zval *zv);
 
 void uopz_set_property(zval *object, zval *member, zval *value);
 void uopz_get_property(zval *object, zval *member, zval *value);
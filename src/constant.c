@@ -25,6 +25,22 @@
 #include "util.h"
 #include "constant.h"
 
+ZEND_EXTERN_MODULE_GLOBALS(uopz);
+
+/* {{{ remember the unqualified name, fetch handlers only bypass their cache for these */
+static void uopz_constant_touch(zend_string *name) {
+	const char *ns = zend_memrchr(ZSTR_VAL(name), '\\', ZSTR_LEN(name));
+
+	if (ns) {
+		ns++;
+
+		zend_hash_str_add_empty_element(&UOPZ(constants),
+			ns, (ZSTR_VAL(name) + ZSTR_LEN(name)) - ns);
+	} else {
+		zend_hash_add_empty_element(&UOPZ(constants), name);
+	}
+} /* }}} */
+
 /* {{{ */
 zend_bool uopz_constant_redefine(zend_class_entry *clazz, zend_string *name, zval *variable) {
 	HashTable *table = clazz ? &clazz->constants_table : EG(zend_constants);
@@ -45,7 +61,7 @@ zend_bool uopz_constant_redefine(zend_class_entry *clazz, zend_string *name, zva
 			
 			zconstant = zend_hash_find_ptr(table, heap);
 
-			/*zend_string_release(key);*/
+			zend_string_release(key);
 
 			key = heap;
 		}
@@ -71,7 +87,9 @@ zend_bool uopz_constant_redefine(zend_class_entry *clazz, zend_string *name, zva
 			Z_TRY_ADDREF_P(variable);
 		}
 
-		/*zend_string_release(key);*/
+		uopz_constant_touch(name);
+
+		zend_string_release(key);
 		return 1;
 	}
 
@@ -86,7 +104,7 @@ zend_bool uopz_constant_redefine(zend_class_entry *clazz, zend_string *name, zva
 		} else {
 			uopz_exception(
 				"failed to redefine the internal %s, not allowed", ZSTR_VAL(name));
-			/*zend_string_release(key);*/
+			zend_string_release(key);
 			return 0;
 		}
 
@@ -98,7 +116,9 @@ zend_bool uopz_constant_redefine(zend_class_entry *clazz, zend_string *name, zva
 		Z_TRY_ADDREF_P(variable);
 	}
 
-	/*zend_string_release(key);*/
+	uopz_constant_touch(name);
+
+	zend_string_release(key);
 	return 1;
 } /* }}} */
 
@@ -114,7 +134,7 @@ zend_bool uopz_constant_undefine(zend_class_entry *clazz, zend_string *name) {
 			size_t nss;
 
 			if (ns) {
-				zend_string *heap = zend_string_tolower(name);	
+				heap = zend_string_tolower(name);
 
 				ns++;
 				nss =  (ZSTR_VAL(name) + ZSTR_LEN(name)) - ns;
@@ -124,7 +144,7 @@ zend_bool uopz_constant_undefine(zend_class_entry *clazz, zend_string *name) {
 				zconstant = zend_hash_find_ptr(table, heap);
 
 				if (!zconstant) {
-					/*zend_string_release(heap);*/
+					zend_string_release(heap);
 					return 0;
 				}
 
@@ -148,7 +168,7 @@ _uopz_constant_undefine:
 				"failed to undefine the internal constant %s, not allowed", ZSTR_VAL(name));
 
 			if (heap) {
-				/*zend_string_release(heap);*/
+				zend_string_release(heap);
 			}
 
 			return 0;
@@ -156,8 +176,10 @@ _uopz_constant_undefine:
 
 		zend_hash_del(table, name);
 
+		uopz_constant_touch(name);
+
 		if (heap) {
-			/*zend_string_release(heap);*/
+			zend_string_release(heap);
 		}
 
 		return 1;
@@ -165,6 +187,8 @@ _uopz_constant_undefine:
 
 	zend_hash_del(table, name);
 
+	uopz_constant_touch(name);
+
 	return 1;
 } /* }}} */
 
@@ -22,17 +22,21 @@
 #include "php.h"
 #include "uopz.h"
 
+#include "util.h"
+#include "hook.h"
+#include "return.h"
 #include "executors.h"
 
 ZEND_EXTERN_MODULE_GLOBALS(uopz);
 
 typedef void (*zend_execute_internal_f) (zend_execute_data *, zval *);
+typedef void (*zend_execute_ex_f) (zend_execute_data *);
 
 void php_uopz_execute_internal(zend_execute_data *execute_data, zval *return_value);
+void php_uopz_execute_ex(zend_execute_data *execute_data);
 
 zend_execute_internal_f zend_execute_internal_function;
-
-void php_uopz_execute_internal(zend_execute_data *execute_data, zval *return_value);
+zend_execute_ex_f zend_execute_ex_function;
 
 void uopz_executors_init(void) { /* {{{ */
 	zend_execute_internal_function = zend_execute_internal;
@@ -43,12 +47,135 @@ void uopz_executors_shutdown(void) { /* {{{ */
 	zend_execute_internal = zend_execute_internal_function;
 } /* }}} */
 
-void php_uopz_execute_internal(zend_execute_data *execute_data, zval *return_value) { /* {{{ LCOV_EXCL_START */
+/* {{{ a bailout out of an internal function leaves the executor switched */
+void uopz_executors_reset(void) {
+#ifndef ZTS
+	if (zend_execute_ex == php_uopz_execute_ex) {
+		zend_execute_ex = zend_execute_ex_function;
+	}
+#endif
+} /* }}} */
+
+/* {{{ user functions called back by internal code are entered through zend_execute_ex,
+	it is switched only for the duration of an internal call while something is intercepted,
+	and switched back for the callee so the vm keeps reentering itself */
+void php_uopz_execute_internal(zend_execute_data *execute_data, zval *return_value) { /* LCOV_EXCL_START */
+#ifndef ZTS
+	zend_execute_ex_f executor = zend_execute_ex;
+
+	if (UOPZ(intercepts) && executor != php_uopz_execute_ex &&
+		!uopz_is_cuf(execute_data) && !uopz_is_cufa(execute_data)) {
+		zend_execute_ex_function = executor;
+		zend_execute_ex = php_uopz_execute_ex;
+	}
+#endif
+
 	if (zend_execute_internal_function) {
 		zend_execute_internal_function(execute_data, return_value);
 	} else execute_internal(execute_data, return_value);
+
+#ifndef ZTS
+	zend_execute_ex = executor;
+#endif
 } /* LCOV_EXCL_STOP }}} */
 
+/* {{{ only callbacks made by internal code, the handlers see every other call */
+static zend_always_inline zend_bool uopz_executors_callback(zend_execute_data *execute_data) {
+	zend_execute_data *prev = EX(prev_execute_data);
+
+	if (!prev || !prev->func || prev->func->type != ZEND_INTERNAL_FUNCTION) {
+		return 0;
+	}
+
+	if (uopz_is_cuf(prev) || uopz_is_cufa(prev)) {
+		return 0;
+	}
+
+	/* a resumed generator is entered again by Generator::next and friends */
+	if (EX(func)->common.fn_flags & (ZEND_ACC_CLOSURE|ZEND_ACC_CALL_VIA_TRAMPOLINE|ZEND_ACC_GENERATOR)) {
+		return 0;
+	}
+
+#ifdef ZEND_CALL_GENERATOR
+	if (ZEND_CALL_INFO(execute_data) & ZEND_CALL_GENERATOR) {
+		return 0;
+	}
+#endif
+
+	/* only frames that were never executed, the engine may have skipped the RECVs */
+	return EX(opline) >= EX(func)->op_array.opcodes &&
+		   EX(opline) <= EX(func)->op_array.opcodes + EX(func)->op_array.num_args;
+} /* }}} */
+
+/* {{{ the frame was entered but never executed, unwind it as the vm would after a return */
+static zend_always_inline void uopz_executors_leave(zend_execute_data *execute_data) {
+	uint32_t call_info = ZEND_CALL_INFO(execute_data);
+
+	EG(current_execute_data) = EX(prev_execute_data);
+
+	zend_free_compiled_variables(execute_data);
+	zend_vm_stack_free_extra_args_ex(call_info, execute_data);
+
+#if PHP_VERSION_ID >= 80000
+	if (call_info & ZEND_CALL_HAS_EXTRA_NAMED_PARAMS) {
+		zend_free_extra_named_params(EX(extra_named_params));
+	}
+#endif
+} /* }}} */
+
+void php_uopz_execute_ex(zend_execute_data *execute_data) { /* {{{ */
+#ifndef ZTS
+	/* only the callee is intercepted, the calls it makes are not callbacks */
+	zend_execute_ex = zend_execute_ex_function;
+#endif
+
+	if (UOPZ(intercepts) && uopz_executors_callback(execute_data)) {
+		uopz_hook_t *uhook = uopz_find_hook(EX(func));
+		uopz_return_t *ureturn = uopz_find_return(EX(func));
+		zend_object *object = Z_TYPE(EX(This)) == IS_OBJECT ? Z_OBJ(EX(This)) : NULL;
+
+		if ((uhook && !uhook->busy) || (ureturn && UOPZ_RETURN_IS_EXECUTABLE(ureturn) && !UOPZ_RETURN_IS_BUSY(ureturn))) {
+			zval *params = uopz_received_args(execute_data);
+
+			if (uhook && !uhook->busy) {
+				uopz_execute_hook(uhook, object, params, ZEND_CALL_NUM_ARGS(execute_data));
+			}
+
+			if (ureturn && UOPZ_RETURN_IS_EXECUTABLE(ureturn) && !UOPZ_RETURN_IS_BUSY(ureturn)) {
+				uopz_execute_return_args(ureturn, object, 
+					params, ZEND_CALL_NUM_ARGS(execute_data), EX(return_value));
+
+				uopz_received_args_free(execute_data, params);
+				uopz_executors_leave(execute_data);
+				goto _uopz_execute_ex_leave;
+			}
+
+			uopz_received_args_free(execute_data, params);
+		}
+
+		if (ureturn && !UOPZ_RETURN_IS_EXECUTABLE(ureturn)) {
+			UOPZ_STAT(calls);
+
+			if (EX(return_value)) {
+				ZVAL_COPY(EX(return_value), &ureturn->value);
+			}
+
+			uopz_executors_leave(execute_data);
+			goto _uopz_execute_ex_leave;
+		}
+	}
+
+	if (zend_execute_ex_function) {
+		zend_execute_ex_function(execute_data);
+	} else execute_ex(execute_data);
+
+_uopz_execute_ex_leave:
+#ifndef ZTS
+	zend_execute_ex = php_uopz_execute_ex;
+#endif
+	return;
+} /* }}} */
+
 #endif	/* UOPZ_HANDLERS_H */
 
 /*
@@ -21,6 +21,7 @@
 
 void uopz_executors_init(void);
 void uopz_executors_shutdown(void);
+void uopz_executors_reset(void);
 
 #endif	/* UOPZ_EXECUTORS_H */
 
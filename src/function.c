@@ -24,6 +24,7 @@
 
 #include "util.h"
 #include "function.h"
+#include "return.h"
 #include "copy.h"
 
 #include <Zend/zend_closures.h>
@@ -47,7 +48,7 @@ zend_bool uopz_add_function(zend_class_entry *clazz, zend_string *name, zval *cl
 				"will not replace existing function %s, use uopz_set_return instead",
 				ZSTR_VAL(name));
 		}
-		/*zend_string_release(key);*/
+		zend_string_release(key);
 		return 0;
 	}
 
@@ -70,6 +71,7 @@ zend_bool uopz_add_function(zend_class_entry *clazz, zend_string *name, zval *cl
 			flags);
 #endif
 	zend_hash_update_ptr(table, key, (void*) function);
+	uopz_dirty(table);
 
 	if (clazz) {
 		if (all) {
@@ -88,7 +90,9 @@ zend_bool uopz_add_function(zend_class_entry *clazz, zend_string *name, zval *cl
 		uopz_handle_magic(clazz, name, function);
 	}
 
-	/*zend_string_release(key);*/
+	uopz_generation_bump();
+
+	zend_string_release(key);
 
 	return 1;
 } /* }}} */
@@ -98,6 +102,7 @@ zend_bool uopz_del_function(zend_class_entry *clazz, zend_string *name, zend_boo
 	HashTable *functions = (HashTable*)
 		zend_hash_index_find_ptr(&UOPZ(functions), (zend_long) table);
 	zend_string *key = zend_string_tolower(name);
+	zend_function *function;
 
 	if (!functions || !zend_hash_exists(functions, key)) {
 		if (clazz) {
@@ -110,7 +115,7 @@ zend_bool uopz_del_function(zend_class_entry *clazz, zend_string *name, zend_boo
 				"cannot delete function %s, it was not added by uopz",
 				ZSTR_VAL(name));
 		}
-		/*zend_string_release(key);*/
+		zend_string_release(key);
 		return 0;
 	}
 
@@ -129,9 +134,285 @@ zend_bool uopz_del_function(zend_class_entry *clazz, zend_string *name, zend_boo
 		}
 	}
 
-    if (zend_hash_exists(table, key)) zend_hash_del(table, key);
+	if ((function = zend_hash_find_ptr(table, key))) {
+		uopz_return_unpatch(function);
+
+		zend_hash_index_del(&UOPZ(replacements), (zend_ulong) function);
+		uopz_replacement_forget(function);
+
+		zend_hash_del(table, key);
+	}
     if (zend_hash_exists(functions, key)) zend_hash_del(functions, key);
-    /*zend_string_release(key);*/
+
+	uopz_generation_release();
+    zend_string_release(key);
+
+	return 1;
+} /* }}} */
+
+#ifdef ZEND_ACC_CTOR
+# define UOPZ_REPLACE_KEEP_FLAGS (ZEND_ACC_PPP_MASK|ZEND_ACC_STATIC|ZEND_ACC_FINAL|ZEND_ACC_CHANGED|ZEND_ACC_ARENA_ALLOCATED|ZEND_ACC_CTOR)
+#else
+# define UOPZ_REPLACE_KEEP_FLAGS (ZEND_ACC_PPP_MASK|ZEND_ACC_STATIC|ZEND_ACC_FINAL|ZEND_ACC_CHANGED|ZEND_ACC_ARENA_ALLOCATED)
+#endif
+
+/* {{{ every copy gets its own cache, sized for the opcodes it now runs */
+static void uopz_replace_cache(zend_op_array *op_array) {
+#ifdef ZEND_ACC_HEAP_RT_CACHE
+	op_array->fn_flags &= ~ZEND_ACC_HEAP_RT_CACHE;
+#endif
+
+#if PHP_VERSION_ID >= 70400
+	ZEND_MAP_PTR_INIT(op_array->run_time_cache, 
+		zend_arena_alloc(&CG(arena), sizeof(void*)));
+	ZEND_MAP_PTR_SET(op_array->run_time_cache, NULL);
+#else
+	op_array->run_time_cache = zend_arena_alloc(&CG(arena), op_array->cache_size);
+
+	memset(op_array->run_time_cache, 0, op_array->cache_size);
+#endif
+} /* }}} */
+
+/* {{{ the target keeps its identity, everything else comes from the body */
+static void uopz_replace_target(zend_function *target, void *arg) {
+	uopz_replacement_t *replacement = arg;
+	zend_op_array *original;
+	zend_op_array *op_array = &target->op_array;
+
+	if (target->type != ZEND_USER_FUNCTION ||
+		op_array->opcodes != replacement->opcodes ||
+		zend_hash_index_exists(&replacement->originals, (zend_ulong) target)) {
+		return;
+	}
+
+	original = emalloc(sizeof(zend_op_array));
+	memcpy(original, op_array, sizeof(zend_op_array));
+
+	zend_hash_index_add_ptr(
+		&replacement->originals, (zend_ulong) target, original);
+
+	memcpy(op_array, &replacement->body->op_array, sizeof(zend_op_array));
+
+	op_array->function_name = original->function_name;
+	op_array->scope = original->scope;
+	op_array->prototype = original->prototype;
+	op_array->doc_comment = original->doc_comment;
+	op_array->fn_flags =
+		(op_array->fn_flags & ~UOPZ_REPLACE_KEEP_FLAGS) |
+		(original->fn_flags & UOPZ_REPLACE_KEEP_FLAGS);
+	memcpy(op_array->reserved, original->reserved, sizeof(op_array->reserved));
+
+	/* the target holds the body now, as inherited copies of it do */
+	(*op_array->refcount)++;
+
+	uopz_replace_cache(op_array);
+} /* }}} */
+
+static zend_always_inline void uopz_restore_statics(zend_op_array *op_array, HashTable *replaced) { /* {{{ */
+	if (op_array->static_variables && 
+		!(GC_FLAGS(op_array->static_variables) & IS_ARRAY_IMMUTABLE)) {
+#if PHP_VERSION_ID >= 70300
+		GC_ADDREF(op_array->static_variables);
+#else
+		GC_REFCOUNT(op_array->static_variables)++;
+#endif
+	}
+
+#if PHP_VERSION_ID >= 70400
+	ZEND_MAP_PTR_INIT(op_array->static_variables_ptr, &op_array->static_variables);
+#endif
+
+	if (replaced && !(GC_FLAGS(replaced) & IS_ARRAY_IMMUTABLE)) {
+		zval statics;
+
+		ZVAL_ARR(&statics, replaced);
+		zval_ptr_dtor(&statics);
+	}
+} /* }}} */
+
+/* {{{ copies the replacement captured get their original back, copies inherited since take the original of the function */
+static void uopz_restore_target(zend_function *target, void *arg) {
+	uopz_replacement_t *replacement = arg;
+	zend_op_array *op_array = &target->op_array;
+	zend_op_array *original;
+
+	if (target->type != ZEND_USER_FUNCTION ||
+		op_array->opcodes != replacement->body->op_array.opcodes) {
+		return;
+	}
+
+	if ((original = zend_hash_index_find_ptr(&replacement->originals, (zend_ulong) target))) {
+		memcpy(op_array, original, sizeof(zend_op_array));
+	} else if ((original = zend_hash_index_find_ptr(&replacement->originals, (zend_ulong) replacement->function))) {
+		zend_op_array inherited;
+
+		memcpy(&inherited, op_array, sizeof(zend_op_array));
+		memcpy(op_array, original, sizeof(zend_op_array));
+
+		op_array->function_name = inherited.function_name;
+		op_array->scope = inherited.scope;
+		op_array->prototype = inherited.prototype;
+		op_array->doc_comment = inherited.doc_comment;
+		op_array->fn_flags =
+			(op_array->fn_flags & ~UOPZ_REPLACE_KEEP_FLAGS) |
+			(inherited.fn_flags & UOPZ_REPLACE_KEEP_FLAGS);
+		memcpy(op_array->reserved, inherited.reserved, sizeof(op_array->reserved));
+
+		uopz_restore_statics(op_array, inherited.static_variables);
+		uopz_replace_cache(op_array);
+
+		(*op_array->refcount)++;
+	} else {
+		return;
+	}
+
+	(*replacement->body->op_array.refcount)--;
+} /* }}} */
+
+/* {{{ a copy is about to be deleted, it must not hold the body or be restored later */
+void uopz_replacement_forget(zend_function *function) {
+	uopz_replacement_t *replacement;
+
+	ZEND_HASH_FOREACH_PTR(&UOPZ(replacements), replacement) {
+		uopz_restore_target(function, replacement);
+
+		zend_hash_index_del(&replacement->originals, (zend_ulong) function);
+	} ZEND_HASH_FOREACH_END();
+} /* }}} */
+
+static void uopz_replacement_original_free(zval *zv) { /* {{{ */
+	efree(Z_PTR_P(zv));
+} /* }}} */
+
+void uopz_replacement_free(zval *zv) { /* {{{ */
+	uopz_replacement_t *replacement = Z_PTR_P(zv);
+
+	uopz_return_unpatch(replacement->function);
+
+	uopz_function_copies(replacement->function, uopz_restore_target, replacement);
+
+	zend_hash_destroy(&replacement->originals);
+
+	/* copies that could not be reached keep the body until they are destroyed */
+	destroy_op_array(&replacement->body->op_array);
+	zval_ptr_dtor(&replacement->closure);
+	efree(replacement);
+} /* }}} */
+
+zend_bool uopz_replace_function(zend_class_entry *clazz, zend_string *name, zval *closure) { /* {{{ */
+	HashTable *table = clazz ? &clazz->function_table : CG(function_table);
+	zend_function *function = NULL;
+	uopz_replacement_t *replacement;
+
+	if (uopz_find_function(table, name, &function) != SUCCESS || 
+		(clazz && function->common.scope != clazz)) {
+		if (clazz) {
+			uopz_exception(
+				"failed to replace method %s::%s, it does not exist",
+				ZSTR_VAL(clazz->name), ZSTR_VAL(name));
+		} else {
+			uopz_exception(
+				"failed to replace function %s, it does not exist",
+				ZSTR_VAL(name));
+		}
+		return 0;
+	}
+
+	if (function->type != ZEND_USER_FUNCTION ||
+		(function->common.fn_flags & (ZEND_ACC_ABSTRACT|ZEND_ACC_CLOSURE|ZEND_ACC_GENERATOR))
+#if PHP_VERSION_ID >= 70400
+		|| (function->common.fn_flags & ZEND_ACC_IMMUTABLE)
+#endif
+	) {
+		if (clazz) {
+			uopz_exception(
+				"failed to replace method %s::%s, not allowed",
+				ZSTR_VAL(clazz->name), ZSTR_VAL(name));
+		} else {
+			uopz_exception(
+				"failed to replace function %s, not allowed",
+				ZSTR_VAL(name));
+		}
+		return 0;
+	}
+
+	if (uopz_function_active(function)) {
+		if (clazz) {
+			uopz_exception(
+				"failed to replace method %s::%s, it is executing",
+				ZSTR_VAL(clazz->name), ZSTR_VAL(name));
+		} else {
+			uopz_exception(
+				"failed to replace function %s, it is executing",
+				ZSTR_VAL(name));
+		}
+		return 0;
+	}
+
+	/* a previous replacement is undone first, so the originals are always the real ones */
+	zend_hash_index_del(&UOPZ(replacements), (zend_ulong) function);
+
+	uopz_return_unpatch(function);
+
+	replacement = emalloc(sizeof(uopz_replacement_t));
+	replacement->function = function;
+	replacement->opcodes = function->op_array.opcodes;
+	ZVAL_COPY(&replacement->closure, closure);
+#if PHP_VERSION_ID >= 80000
+	replacement->body = uopz_copy_closure(function->common.scope, 
+			(zend_function*) zend_get_closure_method_def(Z_OBJ_P(closure)),
+			function->common.fn_flags);
+#else
+	replacement->body = uopz_copy_closure(function->common.scope, 
+			(zend_function*) zend_get_closure_method_def(closure),
+			function->common.fn_flags);
+#endif
+	zend_hash_init(&replacement->originals, 8, NULL, uopz_replacement_original_free, 0);
+
+	uopz_function_copies(function, uopz_replace_target, replacement);
+
+	zend_hash_index_update_ptr(
+		&UOPZ(replacements), (zend_ulong) function, replacement);
+
+	uopz_generation_release();
+
+	return 1;
+} /* }}} */
+
+zend_bool uopz_restore_function(zend_class_entry *clazz, zend_string *name) { /* {{{ */
+	HashTable *table = clazz ? &clazz->function_table : CG(function_table);
+	zend_function *function = NULL;
+
+	if (uopz_find_function(table, name, &function) != SUCCESS ||
+		!zend_hash_index_exists(&UOPZ(replacements), (zend_ulong) function)) {
+		if (clazz) {
+			uopz_exception(
+				"failed to restore method %s::%s, it was not replaced",
+				ZSTR_VAL(clazz->name), ZSTR_VAL(name));
+		} else {
+			uopz_exception(
+				"failed to restore function %s, it was not replaced",
+				ZSTR_VAL(name));
+		}
+		return 0;
+	}
+
+	if (uopz_function_active(function)) {
+		if (clazz) {
+			uopz_exception(
+				"failed to restore method %s::%s, it is executing",
+				ZSTR_VAL(clazz->name), ZSTR_VAL(name));
+		} else {
+			uopz_exception(
+				"failed to restore function %s, it is executing",
+				ZSTR_VAL(name));
+		}
+		return 0;
+	}
+
+	zend_hash_index_del(&UOPZ(replacements), (zend_ulong) function);
+
+	uopz_generation_release();
 
 	return 1;
 } /* }}} */
@@ -207,6 +488,8 @@ void uopz_flags(zend_class_entry *clazz, zend_string *name, zend_long flags, zva
         }
 #endif
 		function->common.fn_flags = flags;
+
+		uopz_generation_bump();
 	}
 	RETURN_LONG(current);
 } /* }}} */
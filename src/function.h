@@ -19,9 +19,22 @@
 #ifndef UOPZ_FUNCTION_H
 #define UOPZ_FUNCTION_H
 
+typedef struct _uopz_replacement_t {
+	zend_function *function;
+	zend_op *opcodes;
+	zend_function *body;
+	zval closure;
+	HashTable originals;
+} uopz_replacement_t;
+
 zend_bool uopz_add_function(zend_class_entry *clazz, zend_string *name, zval *closure, zend_long flags, zend_bool all);
 zend_bool uopz_del_function(zend_class_entry *clazz, zend_string *name, zend_bool all);
 
+zend_bool uopz_replace_function(zend_class_entry *clazz, zend_string *name, zval *closure);
+zend_bool uopz_restore_function(zend_class_entry *clazz, zend_string *name);
+void uopz_replacement_free(zval *zv);
+void uopz_replacement_forget(zend_function *function);
+
 void uopz_flags(zend_class_entry *clazz, zend_string *name, zend_long flags, zval *return_value);
 zend_bool uopz_set_static(zend_class_entry *clazz, zend_string *function, zval *statics);
 zend_bool uopz_get_static(zend_class_entry *clazz, zend_string *function, zval *return_value);
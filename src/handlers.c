@@ -22,10 +22,14 @@
 #include "php.h"
 #include "uopz.h"
 
+#include "Zend/zend_extensions.h"
+
 #include "class.h"
 #include "return.h"
 #include "hook.h"
 #include "util.h"
+#include "internal.h"
+#include "handlers.h"
 
 ZEND_EXTERN_MODULE_GLOBALS(uopz);
 
@@ -84,38 +88,36 @@ ZEND_EXTERN_MODULE_GLOBALS(uopz);
 #endif
 
 #define UOPZ_HANDLERS_DECL_BEGIN() uopz_vm_handler_t uopz_vm_handlers[UOPZ_HANDLERS_COUNT] = {
-#define UOPZ_HANDLER_DECL(o, n) 	{o, &zend_vm_##n, uopz_vm_##n},
+#define UOPZ_HANDLER_DECL(o, n) 	{o, uopz_vm_##n},
 #define UOPZ_HANDLERS_DECL_END()   {0}};
 
+/* the handler uopz replaced, or a handler registered beneath uopz, is what dispatch falls through to */
 #define UOPZ_HANDLER_OVERLOAD(h) do { \
-	*(h)->zend = zend_get_user_opcode_handler((h)->opcode); \
+	uopz_vm_previous[(h)->opcode] = zend_get_user_opcode_handler((h)->opcode); \
+	uopz_vm_owned[(h)->opcode] = (h)->uopz; \
 	zend_set_user_opcode_handler((h)->opcode, (h)->uopz); \
 } while (0)
 
+/* an extension that overwrote uopz keeps its handler, and inherits responsibility for the chain */
 #define UOPZ_HANDLER_RESTORE(h) do { \
-	zend_set_user_opcode_handler((h)->opcode, *(h)->zend); \
+	if (zend_get_user_opcode_handler((h)->opcode) == (h)->uopz) { \
+		zend_set_user_opcode_handler((h)->opcode, uopz_vm_previous[(h)->opcode]); \
+	} \
+	uopz_vm_previous[(h)->opcode] = NULL; \
+	uopz_vm_owned[(h)->opcode] = NULL; \
 } while (0)
 
 typedef int (*zend_vm_handler_t) (UOPZ_OPCODE_HANDLER_ARGS);
 
 typedef struct _uopz_vm_handler_t {
 	zend_uchar        opcode;
-	zend_vm_handler_t *zend;
 	zend_vm_handler_t uopz;
 } uopz_vm_handler_t;
 
-zend_vm_handler_t zend_vm_exit;
-zend_vm_handler_t zend_vm_new;
-zend_vm_handler_t zend_vm_fetch_constant;
-zend_vm_handler_t zend_vm_do_fcall;
-zend_vm_handler_t zend_vm_do_ucall;
-zend_vm_handler_t zend_vm_fetch_class;
-zend_vm_handler_t zend_vm_fetch_class_constant;
-zend_vm_handler_t zend_vm_init_fcall;
-zend_vm_handler_t zend_vm_init_fcall_by_name;
-zend_vm_handler_t zend_vm_init_ns_fcall_by_name;
-zend_vm_handler_t zend_vm_init_method_call;
-zend_vm_handler_t zend_vm_init_static_method_call;
+static zend_vm_handler_t uopz_vm_previous[256];
+static zend_vm_handler_t uopz_vm_owned[256];
+static zend_bool         uopz_vm_checked = 0;
+static int               uopz_vm_resource = -1;
 
 int uopz_vm_exit(UOPZ_OPCODE_HANDLER_ARGS);
 int uopz_vm_new(UOPZ_OPCODE_HANDLER_ARGS);
@@ -157,14 +159,26 @@ static zend_always_inline zval* uopz_get_zval(const zend_op *opline, int op_type
 #endif
 }
 
+/* the observer backend only needs exit, everything else stays on the specialized handlers */
+#define UOPZ_HANDLER_SKIP(h) (UOPZ(observer) && (h)->opcode != ZEND_EXIT)
+
 void uopz_handlers_init(void) {
 	uopz_vm_handler_t *handler = uopz_vm_handlers;
+#if PHP_VERSION_ID < 80000
+	static zend_extension uopz_vm_extension;
+
+	uopz_vm_resource = zend_get_resource_handle(&uopz_vm_extension);
+#else
+	uopz_vm_resource = zend_get_resource_handle("uopz");
+#endif
 
 	while (handler) {
 		if (!handler->opcode) {
 			break;
 		}
-		UOPZ_HANDLER_OVERLOAD(handler);
+		if (!UOPZ_HANDLER_SKIP(handler)) {
+			UOPZ_HANDLER_OVERLOAD(handler);
+		}
 		handler++;
 	}
 }
@@ -176,59 +190,61 @@ void uopz_handlers_shutdown(void) {
 		if (!handler->opcode) {
 			break;
 		}
-		UOPZ_HANDLER_RESTORE(handler);
+		if (!UOPZ_HANDLER_SKIP(handler)) {
+			UOPZ_HANDLER_RESTORE(handler);
+		}
 		handler++;
 	}
 }
 
-static zend_always_inline int _uopz_vm_dispatch(UOPZ_OPCODE_HANDLER_ARGS) {
-	zend_vm_handler_t zend = NULL;
+/* {{{ an extension loaded after uopz that set a handler without chaining silently disables interception */
+void uopz_handlers_check(void) {
+	uopz_vm_handler_t *handler = uopz_vm_handlers;
 
-	switch (EX(opline)->opcode) {
-		case ZEND_EXIT:
-			zend = zend_vm_exit;
-		break;
+	if (uopz_vm_checked) {
+		return;
+	}
 
-		case ZEND_NEW:
-			zend = zend_vm_new;
-		break;
+	uopz_vm_checked = 1;
 
-		case ZEND_INIT_FCALL_BY_NAME:
-			zend = zend_vm_init_fcall_by_name;
-		break;
+	while (handler) {
+		if (!handler->opcode) {
+			break;
+		}
+		if (!UOPZ_HANDLER_SKIP(handler) &&
+			zend_get_user_opcode_handler(handler->opcode) != handler->uopz) {
+			zend_error(E_CORE_WARNING,
+				"uopz: the handler for %s was overwritten by another extension, "
+				"it should be installed with uopz_handler_register",
+				zend_get_opcode_name(handler->opcode));
+		}
+		handler++;
+	}
+} /* }}} */
 
-		case ZEND_INIT_FCALL:
-			zend = zend_vm_init_fcall;
-		break;
+/* {{{ for opcodes uopz handles, the handler is chained beneath uopz and the handler it displaced is returned,
+	callers dispatch to that handler (or return ZEND_USER_OPCODE_DISPATCH when it is NULL), there is no second
+	table lookup in the engine, for other opcodes this is zend_set_user_opcode_handler */
+PHP_UOPZ_API user_opcode_handler_t uopz_handler_register(zend_uchar opcode, user_opcode_handler_t handler) {
+	user_opcode_handler_t previous;
 
-		case ZEND_INIT_NS_FCALL_BY_NAME:
-			zend = zend_vm_init_ns_fcall_by_name;
-		break;
+	if (uopz_vm_owned[opcode]) {
+		previous = uopz_vm_previous[opcode];
 
-		case ZEND_INIT_METHOD_CALL:
-			zend = zend_vm_init_method_call;
-		break;
+		uopz_vm_previous[opcode] = handler;
 
-		case ZEND_INIT_STATIC_METHOD_CALL:
-			zend = zend_vm_init_static_method_call;
-		break;		
+		return previous;
+	}
 
-		case ZEND_FETCH_CONSTANT:
-			zend = zend_vm_fetch_constant;
-		break;
+	previous = zend_get_user_opcode_handler(opcode);
 
-		case ZEND_FETCH_CLASS_CONSTANT:
-			zend = zend_vm_fetch_class_constant;
-		break;
+	zend_set_user_opcode_handler(opcode, handler);
 
-		case ZEND_DO_FCALL:
-			zend = zend_vm_do_fcall;
-		break;
+	return previous;
+} /* }}} */
 
-		case ZEND_DO_UCALL:
-			zend = zend_vm_do_ucall;
-		break;
-	}
+static zend_always_inline int _uopz_vm_dispatch(UOPZ_OPCODE_HANDLER_ARGS) {
+	zend_vm_handler_t zend = uopz_vm_previous[EX(opline)->opcode];
 
 	if (zend) {
 		return zend(UOPZ_OPCODE_HANDLER_ARGS_PASSTHRU);
@@ -244,7 +260,7 @@ int uopz_vm_exit(UOPZ_OPCODE_HANDLER_ARGS) { /* {{{ */
 	zend_free_op free_op1;
 #endif
 
-	if (UOPZ(exit)) {
+	if (UOPZ(exit) || !UOPZ(intercept_exit)) {
 		UOPZ_VM_DISPATCH();
 	}
 
@@ -297,41 +313,52 @@ int uopz_vm_exit(UOPZ_OPCODE_HANDLER_ARGS) { /* {{{ */
 	}
 } /* }}} */
 
-int uopz_vm_new(UOPZ_OPCODE_HANDLER_ARGS) { /* {{{ */
+/* {{{ only a mocked instantiation is taken over, every other one is the engine's */
+int uopz_vm_new(UOPZ_OPCODE_HANDLER_ARGS) {
 	UOPZ_USE_OPLINE;
 	zval *result;
 	zend_function *constructor;
 	zend_class_entry *ce;
 	zend_execute_data *call;
 	zend_object *obj = NULL;
-	
-	UOPZ_SAVE_OPLINE();
+	uopz_mock_t *mock = NULL;
 
-	if (opline->op1_type == IS_CONST) {
-		if (uopz_find_mock(Z_STR_P(EX_CONSTANT(opline->op1)), &obj, &ce) != SUCCESS) {
-			ce = zend_fetch_class_by_name(
-				Z_STR_P(EX_CONSTANT(opline->op1)),
-#if PHP_VERSION_ID >= 70400
-                Z_STR_P(EX_CONSTANT(opline->op1) + 1),
-#else
-				EX_CONSTANT(opline->op1) + 1,
-#endif
-				ZEND_FETCH_CLASS_DEFAULT | ZEND_FETCH_CLASS_EXCEPTION);
-
-			if (ce == NULL) {
-				ZVAL_UNDEF(EX_VAR(opline->result.var));
+	if (EXPECTED(!zend_hash_num_elements(&UOPZ(mocks)))) {
+		UOPZ_VM_DISPATCH();
+	}
 
-				UOPZ_VM_DISPATCH();
-			}
-		}
+	if (opline->op1_type == IS_CONST) {
+		/* the second literal is the lowercase name */
+		mock = uopz_find_mock_lc(Z_STR_P(EX_CONSTANT(opline->op1) + 1));
 	} else if (opline->op1_type == IS_UNUSED) {
+		UOPZ_SAVE_OPLINE();
+
 		ce = zend_fetch_class(
 			NULL, opline->op1.num);
-		uopz_find_mock(ce->name, &obj, &ce);	
+
+		if (!ce) {
+			ZVAL_UNDEF(EX_VAR(opline->result.var));
+
+			UOPZ_HANDLE_EXCEPTION();
+		}
+
+		mock = uopz_find_mock_ce(ce);
 	} else {
-		ce = Z_CE_P(
-			EX_VAR(opline->op1.var));
-		uopz_find_mock(ce->name, &obj, &ce);
+		mock = uopz_find_mock_ce(
+			Z_CE_P(EX_VAR(opline->op1.var)));
+	}
+
+	if (!mock) {
+		UOPZ_VM_DISPATCH();
+	}
+
+	UOPZ_SAVE_OPLINE();
+	UOPZ_STAT(mocks);
+
+	if (!(ce = uopz_mock_class(mock, &obj))) {
+		ZVAL_UNDEF(EX_VAR(opline->result.var));
+
+		UOPZ_HANDLE_EXCEPTION();
 	}
 
 	if (obj != NULL) {
@@ -432,10 +459,30 @@ static zend_always_inline void uopz_run_hook(zend_function *function, zend_execu
 	uopz_hook_t *uhook = uopz_find_hook(function);
 
 	if (uhook && !uhook->busy) {
-		uopz_execute_hook(uhook, execute_data, 0, 0);
+		uopz_execute_hook(uhook,
+			Z_TYPE(EX(This)) == IS_OBJECT ? Z_OBJ(EX(This)) : NULL,
+			ZEND_CALL_ARG(execute_data, 1),
+			ZEND_CALL_NUM_ARGS(execute_data));
 	}
 } /* }}} */
 
+/* {{{ the callee never ran, release what the call frame holds */
+static zend_always_inline void uopz_vm_release_call(zend_execute_data *call) {
+	zend_vm_stack_free_args(call);
+
+	if (ZEND_CALL_INFO(call) & ZEND_CALL_RELEASE_THIS) {
+		OBJ_RELEASE(Z_OBJ(call->This));
+	}
+
+#if PHP_VERSION_ID >= 80000
+	if (ZEND_CALL_INFO(call) & ZEND_CALL_HAS_EXTRA_NAMED_PARAMS) {
+		zend_free_extra_named_params(call->extra_named_params);
+	}
+#endif
+
+	zend_vm_stack_free_call_frame(call);
+} /* }}} */
+
 /* {{{ */
 static zend_always_inline int php_uopz_leave_helper(zend_execute_data *execute_data) {
 	zend_execute_data *call = EX(call);
@@ -443,17 +490,65 @@ static zend_always_inline int php_uopz_leave_helper(zend_execute_data *execute_d
 	EX(call) = call->prev_execute_data;
 	EX(opline) = EX(opline) + 1;
 
-	zend_vm_stack_free_call_frame(call);
+	uopz_vm_release_call(call);
 
 	UOPZ_VM_LEAVE();
 } /* }}} */
 
+/* {{{ a memoized site stays on this frame, there is nothing to reload */
+static zend_always_inline int uopz_vm_site_continue(UOPZ_OPCODE_HANDLER_ARGS) {
+	zend_execute_data *call = EX(call);
+
+	EX(call) = call->prev_execute_data;
+	EX(opline) = EX(opline) + 1;
+
+	uopz_vm_release_call(call);
+
+	UOPZ_VM_CONTINUE();
+} /* }}} */
+
+/* {{{ */
+static zend_always_inline uopz_return_t* uopz_vm_site_find(const zend_op *opline, zend_function *function) {
+	uopz_site_t *site = zend_hash_index_find_ptr(&UOPZ(sites), (zend_ulong) opline);
+
+	if (site && site->function == function) {
+		return site->ureturn;
+	}
+
+	return NULL;
+} /* }}} */
+
+/* {{{ only constant returns on functions without a hook are memoized */
+static zend_always_inline void uopz_vm_site_add(const zend_op *opline, zend_function *function, uopz_return_t *ureturn) {
+	uopz_site_t site;
+
+	if (UOPZ_RETURN_IS_EXECUTABLE(ureturn) || uopz_find_hook(function)) {
+		return;
+	}
+
+	site.function = function;
+	site.ureturn = ureturn;
+
+	zend_hash_index_update_mem(&UOPZ(sites), (zend_ulong) opline, &site, sizeof(uopz_site_t));
+} /* }}} */
+
 int uopz_vm_do_call_common(UOPZ_OPCODE_HANDLER_ARGS) { /* {{{ */
 	zend_execute_data *call = EX(call);
 
-	if (call) {
+	/* nothing is intercepted, leave the call to the engine, internal functions intercept themselves */
+	if (call && UOPZ(intercepts) && !uopz_internal_trampolined(call->func)) {
 		uopz_return_t *ureturn;
 
+		if (UOPZ(specialize) && (ureturn = uopz_vm_site_find(EX(opline), call->func))) {
+			UOPZ_STAT(calls);
+
+			if (RETURN_VALUE_USED(EX(opline))) {
+				ZVAL_COPY(EX_VAR(EX(opline)->result.var), &ureturn->value);
+			}
+
+			return uopz_vm_site_continue(UOPZ_OPCODE_HANDLER_ARGS_PASSTHRU);
+		}
+
 		uopz_run_hook(call->func, call);
 
 		ureturn = uopz_find_return(call->func);
@@ -463,6 +558,10 @@ int uopz_vm_do_call_common(UOPZ_OPCODE_HANDLER_ARGS) { /* {{{ */
 			zval rv, *return_value = RETURN_VALUE_USED(opline) ?
 				EX_VAR(EX(opline)->result.var) : &rv;
 
+			if (UOPZ(specialize)) {
+				uopz_vm_site_add(opline, call->func, ureturn);
+			}
+
 			if (UOPZ_RETURN_IS_EXECUTABLE(ureturn)) {
 				if (UOPZ_RETURN_IS_BUSY(ureturn)) {
 					goto _uopz_vm_do_fcall_dispatch;
@@ -477,6 +576,8 @@ int uopz_vm_do_call_common(UOPZ_OPCODE_HANDLER_ARGS) { /* {{{ */
 				return php_uopz_leave_helper(UOPZ_OPCODE_HANDLER_ARGS_PASSTHRU);
 			}
 
+			UOPZ_STAT(calls);
+
 			if (RETURN_VALUE_USED(opline)) {
 				ZVAL_COPY(return_value, &ureturn->value);
 			}
@@ -486,6 +587,11 @@ int uopz_vm_do_call_common(UOPZ_OPCODE_HANDLER_ARGS) { /* {{{ */
 	}
 
 _uopz_vm_do_fcall_dispatch:
+	/* a patched callee intercepts itself, it is only counted here */
+	if (UNEXPECTED(UOPZ(patches)) && call && uopz_return_stub(call->func)) {
+		UOPZ_STAT(calls);
+	}
+
 	UOPZ_VM_DISPATCH();
 } /* }}} */
 
@@ -497,66 +603,224 @@ int uopz_vm_do_fcall(UOPZ_OPCODE_HANDLER_ARGS) { /* {{{ */
 	return uopz_vm_do_call_common(UOPZ_OPCODE_HANDLER_ARGS_PASSTHRU);
 } /* }}} */
 
-int uopz_vm_call_common(UOPZ_OPCODE_HANDLER_ARGS) { /* {{{ */
+/* {{{ the class a static reference to a constant name resolves to, NULL leaves it to the engine */
+static zend_always_inline zend_class_entry* uopz_vm_static_mock(zval *name) {
+	uopz_mock_t *mock;
+
+	/* the second literal is the lowercase name */
+	if (!(mock = uopz_find_mock_lc(Z_STR_P(name + 1))) || !mock->statics) {
+		return NULL;
+	}
+
+	UOPZ_STAT(mocks);
+
+	return uopz_mock_class(mock, NULL);
+} /* }}} */
+
 #if PHP_VERSION_ID >= 70300
-	CACHE_PTR(EX(opline)->result.num, NULL);
+#	define UOPZ_VM_CONSTANT(o, n) RT_CONSTANT(o, n)
 #else
-	zval *function_name = EX_CONSTANT(EX(opline)->op2);
-	CACHE_PTR(Z_CACHE_SLOT_P(function_name), NULL);
+#	define UOPZ_VM_CONSTANT(o, n) EX_CONSTANT(n)
 #endif
 
-	UOPZ_VM_DISPATCH();
-} /* }}} */
+/* {{{ clears what a call site caches about its callee, and the class a static reference caches */
+static void uopz_vm_cache_clear_site(zend_execute_data *execute_data, const zend_op *opline) {
+	switch (opline->opcode) {
+		case ZEND_INIT_FCALL:
+		case ZEND_INIT_FCALL_BY_NAME:
+		case ZEND_INIT_NS_FCALL_BY_NAME:
+#if PHP_VERSION_ID >= 70300
+			CACHE_PTR(opline->result.num, NULL);
+#else
+			CACHE_PTR(Z_CACHE_SLOT_P(UOPZ_VM_CONSTANT(opline, opline->op2)), NULL);
+#endif
+		break;
 
-int uopz_vm_init_fcall(UOPZ_OPCODE_HANDLER_ARGS) { /* {{{ */
-	return uopz_vm_call_common(UOPZ_OPCODE_HANDLER_ARGS_PASSTHRU);
-} /* }}} */
+		case ZEND_INIT_METHOD_CALL:
+			if (opline->op2_type == IS_CONST) {
+#if PHP_VERSION_ID >= 70300
+				CACHE_PTR(opline->result.num, NULL);
+				CACHE_PTR(opline->result.num + sizeof(void*), NULL);
+#else
+				CACHE_POLYMORPHIC_PTR(
+					Z_CACHE_SLOT_P(UOPZ_VM_CONSTANT(opline, opline->op2)), NULL, NULL);
+#endif
+			}
+		break;
 
-int uopz_vm_init_fcall_by_name(UOPZ_OPCODE_HANDLER_ARGS) { /* {{{ */
-	return uopz_vm_call_common(UOPZ_OPCODE_HANDLER_ARGS_PASSTHRU);
-} /* }}} */
+		case ZEND_INIT_STATIC_METHOD_CALL:
+#if PHP_VERSION_ID >= 70300
+			if (opline->op1_type == IS_CONST || opline->op2_type == IS_CONST) {
+				CACHE_PTR(opline->result.num, NULL);
 
-int uopz_vm_init_ns_fcall_by_name(UOPZ_OPCODE_HANDLER_ARGS) { /* {{{ */
-	return uopz_vm_call_common(UOPZ_OPCODE_HANDLER_ARGS_PASSTHRU);
-} /* }}} */
+				if (opline->op2_type == IS_CONST) {
+					CACHE_PTR(opline->result.num + sizeof(void*), NULL);
+				}
+			}
+#else
+			if (opline->op2_type == IS_CONST) {
+				if (opline->op1_type == IS_CONST) {
+					CACHE_PTR(Z_CACHE_SLOT_P(UOPZ_VM_CONSTANT(opline, opline->op2)), NULL);
+				} else {
+					CACHE_POLYMORPHIC_PTR(
+						Z_CACHE_SLOT_P(UOPZ_VM_CONSTANT(opline, opline->op2)), NULL, NULL);
+				}
+			}
 
-int uopz_vm_init_method_call(UOPZ_OPCODE_HANDLER_ARGS) { /* {{{ */
-	if (EX(opline)->op2_type == IS_CONST) {
+			if (opline->op1_type == IS_CONST) {
+				CACHE_PTR(Z_CACHE_SLOT_P(UOPZ_VM_CONSTANT(opline, opline->op1)), NULL);
+			}
+#endif
+		break;
+
+		case ZEND_FETCH_CLASS_CONSTANT:
+			if (opline->op1_type == IS_CONST) {
 #if PHP_VERSION_ID >= 70300
-		CACHE_PTR(EX(opline)->result.num, NULL);
-		CACHE_PTR(EX(opline)->result.num + sizeof(void*), NULL);
+				CACHE_PTR(opline->extended_value, NULL);
+				CACHE_PTR(opline->extended_value + sizeof(void*), NULL);
 #else
-		zval *function_name = EX_CONSTANT(EX(opline)->op2);
-		CACHE_POLYMORPHIC_PTR(Z_CACHE_SLOT_P(function_name), NULL, NULL);
+				CACHE_PTR(Z_CACHE_SLOT_P(UOPZ_VM_CONSTANT(opline, opline->op1)), NULL);
+				CACHE_PTR(Z_CACHE_SLOT_P(UOPZ_VM_CONSTANT(opline, opline->op2)), NULL);
 #endif
+			}
+		break;
+
+		default:
+			return;
 	}
-	UOPZ_VM_DISPATCH();
+
+	UOPZ_STAT(slots);
 } /* }}} */
 
-int uopz_vm_init_static_method_call(UOPZ_OPCODE_HANDLER_ARGS) { /* {{{ */
-	if (EX(opline)->op2_type == IS_CONST) {
-#if PHP_VERSION_ID < 70300
-		zval *function_name = EX_CONSTANT(EX(opline)->op2);
-#endif
-		if (EX(opline)->op1_type == IS_CONST) {
-#if PHP_VERSION_ID >= 70300
-			CACHE_PTR(EX(opline)->result.num + sizeof(void*), NULL);
-#else
-			CACHE_PTR(Z_CACHE_SLOT_P(function_name), NULL);
+static void uopz_vm_cache_clear(zend_execute_data *execute_data, zend_op_array *op_array) { /* {{{ */
+	const zend_op *opline = op_array->opcodes,
+				  *end = opline + op_array->last;
+
+	while (opline < end) {
+		uopz_vm_cache_clear_site(execute_data, opline++);
+	}
+} /* }}} */
+
+/* {{{ opcache shares immutable op arrays between processes, they are never written */
+static zend_always_inline zend_bool uopz_vm_stamped(zend_op_array *op_array) {
+#ifdef ZEND_ACC_IMMUTABLE
+	if (op_array->fn_flags & ZEND_ACC_IMMUTABLE) {
+		return 0;
+	}
 #endif
+	return uopz_vm_resource >= 0;
+} /* }}} */
+
+/* {{{ a function clears every call site it caches once per generation, the first time it needs one,
+	the generation it last cleared at is stamped on the op array, or kept for its cache when it is shared */
+static zend_always_inline void uopz_vm_cache_check(zend_execute_data *execute_data) {
+	zend_op_array *op_array = &EX(func)->op_array;
+
+	if (EXPECTED(!UOPZ(generation))) {
+		return;
+	}
+
+	if (EXPECTED(uopz_vm_stamped(op_array))) {
+		if (EXPECTED((zend_long) (zend_uintptr_t) op_array->reserved[uopz_vm_resource] == UOPZ(generation))) {
+			return;
+		}
+
+		op_array->reserved[uopz_vm_resource] = (void*) (zend_uintptr_t) UOPZ(generation);
+	} else {
+		zval *seen = zend_hash_index_find(&UOPZ(stamps), (zend_ulong) EX(run_time_cache));
+
+		if (seen) {
+			if (Z_LVAL_P(seen) == UOPZ(generation)) {
+				return;
+			}
+
+			ZVAL_LONG(seen, UOPZ(generation));
 		} else {
+			zval generation;
+
+			ZVAL_LONG(&generation, UOPZ(generation));
+			zend_hash_index_add_new(&UOPZ(stamps), (zend_ulong) EX(run_time_cache), &generation);
+		}
+	}
+
+	uopz_vm_cache_clear(execute_data, op_array);
+} /* }}} */
+
+/* {{{ every call initializing opcode that caches its callee has it cleared once per generation,
+	INIT_DYNAMIC_CALL and INIT_USER_CALL resolve the callee on every execution and have nothing to clear */
+static zend_always_inline int uopz_vm_init_call(UOPZ_OPCODE_HANDLER_ARGS) {
+	const zend_op *opline = EX(opline);
+
+	uopz_vm_cache_check(execute_data);
+
+	/* a cleared class slot is seeded with the mock, the engine caches what it finds there */
+	if (opline->opcode == ZEND_INIT_STATIC_METHOD_CALL && 
+		opline->op1_type == IS_CONST && UOPZ(statics)) {
 #if PHP_VERSION_ID >= 70300
-			CACHE_PTR(EX(opline)->result.num, NULL);
-			CACHE_PTR(EX(opline)->result.num + sizeof(void*), NULL);
+		if (!CACHED_PTR(opline->result.num)) {
+			CACHE_PTR(opline->result.num, uopz_vm_static_mock(EX_CONSTANT(opline->op1)));
+		}
 #else
-			CACHE_POLYMORPHIC_PTR(Z_CACHE_SLOT_P(function_name), NULL, NULL);
+		zval *class_name = EX_CONSTANT(opline->op1);
+
+		if (!CACHED_PTR(Z_CACHE_SLOT_P(class_name))) {
+			CACHE_PTR(Z_CACHE_SLOT_P(class_name), uopz_vm_static_mock(class_name));
+		}
 #endif
+
+		if (EG(exception)) {
+			UOPZ_HANDLE_EXCEPTION();
 		}
 	}
+
 	UOPZ_VM_DISPATCH();
 } /* }}} */
 
+int uopz_vm_init_fcall(UOPZ_OPCODE_HANDLER_ARGS) { /* {{{ */
+	return uopz_vm_init_call(UOPZ_OPCODE_HANDLER_ARGS_PASSTHRU);
+} /* }}} */
+
+int uopz_vm_init_fcall_by_name(UOPZ_OPCODE_HANDLER_ARGS) { /* {{{ */
+	return uopz_vm_init_call(UOPZ_OPCODE_HANDLER_ARGS_PASSTHRU);
+} /* }}} */
+
+int uopz_vm_init_ns_fcall_by_name(UOPZ_OPCODE_HANDLER_ARGS) { /* {{{ */
+	return uopz_vm_init_call(UOPZ_OPCODE_HANDLER_ARGS_PASSTHRU);
+} /* }}} */
+
+int uopz_vm_init_method_call(UOPZ_OPCODE_HANDLER_ARGS) { /* {{{ */
+	return uopz_vm_init_call(UOPZ_OPCODE_HANDLER_ARGS_PASSTHRU);
+} /* }}} */
+
+int uopz_vm_init_static_method_call(UOPZ_OPCODE_HANDLER_ARGS) { /* {{{ */
+	return uopz_vm_init_call(UOPZ_OPCODE_HANDLER_ARGS_PASSTHRU);
+} /* }}} */
+
+/* {{{ only constants redefined or undefined by uopz need to bypass the cache */
+static zend_always_inline zend_bool uopz_vm_constant_touched(zval *name) {
+	const char *ns;
+
+	if (EXPECTED(!zend_hash_num_elements(&UOPZ(constants)))) {
+		return 0;
+	}
+
+	ns = zend_memrchr(Z_STRVAL_P(name), '\\', Z_STRLEN_P(name));
+
+	if (!ns) {
+		return zend_hash_exists(&UOPZ(constants), Z_STR_P(name));
+	}
+
+	ns++;
+
+	return zend_hash_str_exists(&UOPZ(constants),
+		ns, (Z_STRVAL_P(name) + Z_STRLEN_P(name)) - ns);
+} /* }}} */
+
 int uopz_vm_fetch_constant(UOPZ_OPCODE_HANDLER_ARGS) { /* {{{ */
+	if (!uopz_vm_constant_touched(EX_CONSTANT(EX(opline)->op2))) {
+		UOPZ_VM_DISPATCH();
+	}
+
 #if PHP_VERSION_ID >= 70300
 	CACHE_PTR(EX(opline)->extended_value, NULL);
 #else
@@ -568,6 +832,31 @@ int uopz_vm_fetch_constant(UOPZ_OPCODE_HANDLER_ARGS) { /* {{{ */
 } /* }}} */
 
 int uopz_vm_fetch_class_constant(UOPZ_OPCODE_HANDLER_ARGS) { /* {{{ */
+	if (EX(opline)->op1_type == IS_CONST && UOPZ(statics)) {
+		uopz_vm_cache_check(execute_data);
+
+#if PHP_VERSION_ID >= 70300
+		if (!CACHED_PTR(EX(opline)->extended_value)) {
+			CACHE_PTR(EX(opline)->extended_value, 
+				uopz_vm_static_mock(EX_CONSTANT(EX(opline)->op1)));
+		}
+#else
+		zval *class_name = EX_CONSTANT(EX(opline)->op1);
+
+		if (!CACHED_PTR(Z_CACHE_SLOT_P(class_name))) {
+			CACHE_PTR(Z_CACHE_SLOT_P(class_name), uopz_vm_static_mock(class_name));
+		}
+#endif
+
+		if (EG(exception)) {
+			UOPZ_HANDLE_EXCEPTION();
+		}
+	}
+
+	if (!uopz_vm_constant_touched(EX_CONSTANT(EX(opline)->op2))) {
+		UOPZ_VM_DISPATCH();
+	}
+
 #if PHP_VERSION_ID < 70300
 	CACHE_PTR(Z_CACHE_SLOT_P(EX_CONSTANT(EX(opline)->op2)), NULL);
 #else
@@ -21,6 +21,7 @@
 
 void uopz_handlers_init(void);
 void uopz_handlers_shutdown(void);
+void uopz_handlers_check(void);
 
 #endif	/* UOPZ_HANDLERS_H */
 
@@ -24,6 +24,8 @@
 
 #include "util.h"
 #include "hook.h"
+#include "internal.h"
+#include "observer.h"
 
 #include <Zend/zend_closures.h>
 
@@ -33,7 +35,7 @@ zend_bool uopz_set_hook(zend_class_entry *clazz, zend_string *name, zval *closur
 	HashTable *hooks;
 	uopz_hook_t hook;
 	zend_string *key = zend_string_tolower(name);
-	zend_function *function;
+	zend_function *function = NULL;
 
 	if (clazz) {
 		if (uopz_find_method(clazz, key, &function) != SUCCESS) {
@@ -41,7 +43,7 @@ zend_bool uopz_set_hook(zend_class_entry *clazz, zend_string *name, zval *closur
 				"failed to set hook for %s::%s, the method does not exist",
 				ZSTR_VAL(clazz->name),
 				ZSTR_VAL(name));
-			/*zend_string_release(key);*/
+			zend_string_release(key);
 			return 0;
 		}
 
@@ -51,9 +53,11 @@ zend_bool uopz_set_hook(zend_class_entry *clazz, zend_string *name, zval *closur
 				ZSTR_VAL(clazz->name),
 				ZSTR_VAL(name),
 				ZSTR_VAL(function->common.scope->name));
-			/*zend_string_release(key);*/
+			zend_string_release(key);
 			return 0;
 		}
+	} else if (uopz_find_function(CG(function_table), key, &function) != SUCCESS) {
+		function = NULL;
 	}
 
 	if (clazz) {
@@ -74,56 +78,68 @@ zend_bool uopz_set_hook(zend_class_entry *clazz, zend_string *name, zval *closur
 	hook.function = zend_string_copy(name);
 	ZVAL_COPY(&hook.closure, closure);
 
+	if (!zend_hash_exists(hooks, key)) {
+		UOPZ(intercepts)++;
+	}
+
 	zend_hash_update_mem(
 		hooks, key, &hook, sizeof(uopz_hook_t));
-	/*zend_string_release(key);*/
+	uopz_hook_cache_flush();
+	uopz_observer_reset(function);
+	uopz_internal_attach(function);
+
+	zend_string_release(key);
 	return 1;
 } /* }}} */
 
 zend_bool uopz_unset_hook(zend_class_entry *clazz, zend_string *function) { /* {{{ */
 	HashTable *hooks;
 	zend_string *key = zend_string_tolower(function);
+	zend_function *internal = NULL;
 
 	if (clazz) {
 		hooks = zend_hash_find_ptr(&UOPZ(hooks), clazz->name);
 	} else hooks = zend_hash_index_find_ptr(&UOPZ(hooks), 0);
 
 	if (!hooks || !zend_hash_exists(hooks, key)) {
-		/*zend_string_release(key);*/
+		zend_string_release(key);
 		return 0;
 	}
 
 	zend_hash_del(hooks, key);
-	/*zend_string_release(key);*/
+
+	UOPZ(intercepts)--;
+	uopz_hook_cache_flush();
+
+	if (clazz) {
+		uopz_find_method(clazz, key, &internal);
+	} else uopz_find_function(CG(function_table), key, &internal);
+
+	uopz_observer_reset(internal);
+	uopz_internal_detach(internal);
+
+	zend_string_release(key);
 
 	return 1;
 } /* }}} */
 
 void uopz_get_hook(zend_class_entry *clazz, zend_string *function, zval *return_value) { /* {{{ */
 	HashTable *hooks;
-	uopz_hook_t *uhook;
-	zend_string *key = zend_string_tolower(function);
+	zval *uhook;
 	
 	if (clazz) {
 		hooks = zend_hash_find_ptr(&UOPZ(hooks), clazz->name);
 	} else hooks = zend_hash_index_find_ptr(&UOPZ(hooks), 0);
 
-	if (!hooks || !zend_hash_exists(hooks, key)) {
-		/*zend_string_release(key);*/
+	if (!hooks || !(uhook = uopz_hash_find_lc(hooks, function))) {
 		return;
 	}
 
-	uhook = zend_hash_find_ptr(hooks, key);
-
-	ZVAL_COPY(return_value, &uhook->closure);
-
-	/*zend_string_release(key);*/
+	ZVAL_COPY(return_value, &((uopz_hook_t*) Z_PTR_P(uhook))->closure);
 } /* }}} */
 
-uopz_hook_t* uopz_find_hook(zend_function *function) { /* {{{ */
-    return NULL;
-
-	zend_string *key;
+static uopz_hook_t* uopz_resolve_hook(zend_function *function) { /* {{{ */
+	zval *found;
 	uopz_hook_t *uhook;
 	HashTable *hooks;
 
@@ -145,54 +161,116 @@ uopz_hook_t* uopz_find_hook(zend_function *function) { /* {{{ */
 		if (function->common.prototype && 
 		    function->common.prototype->common.scope &&
 		    function->common.prototype->common.scope->ce_flags & ZEND_ACC_INTERFACE) {
-			return uopz_find_hook(
+			return uopz_resolve_hook(
 				function->common.prototype);
 		}
 		return NULL;
 	}
 
-	key = zend_string_tolower(function->common.function_name);
-	uhook = zend_hash_find_ptr(hooks, key);
-	/*zend_string_release(key);*/
+	found = uopz_hash_find_lc(hooks, function->common.function_name);
+	uhook = found ? Z_PTR_P(found) : NULL;
 
 	return uhook;
 } /* }}} */
 
-void uopz_execute_hook(uopz_hook_t *uhook, zend_execute_data *execute_data, zend_bool skip, zend_bool variadic) { /* {{{ */
+uopz_hook_t* uopz_find_hook(zend_function *function) { /* {{{ */
+	uopz_hook_t *uhook;
+	zval *cached;
+	zend_long start;
+
+	if (!function || !zend_hash_num_elements(&UOPZ(hooks))) {
+		return NULL;
+	}
+
+	if (function->common.fn_flags & ZEND_ACC_CLOSURE) {
+		return NULL;
+	}
+
+	UOPZ_STAT(lookups);
+	start = uopz_stats_clock();
+
+	/* the trampoline is shared by every magic call, it cannot be cached */
+	if (function->common.fn_flags & ZEND_ACC_CALL_VIA_TRAMPOLINE) {
+		uhook = uopz_resolve_hook(function);
+	} else if ((cached = zend_hash_index_find(&UOPZ(hcache), (zend_ulong) function))) {
+		uhook = Z_PTR_P(cached);
+	} else {
+		uhook = uopz_resolve_hook(function);
+
+		zend_hash_index_add_new_ptr(
+			&UOPZ(hcache), (zend_ulong) function, uhook);
+	}
+
+	if (uhook) {
+		UOPZ_STAT(hits);
+	}
+
+	uopz_stats_elapsed(start);
+
+	return uhook;
+} /* }}} */
+
+void uopz_hook_cache_flush(void) { /* {{{ */
+	zend_hash_clean(&UOPZ(hcache));
+	zend_hash_clean(&UOPZ(sites));
+} /* }}} */
+
+/* {{{ the closure is bound to the scope once, $this is supplied per call */
+static zend_always_inline void uopz_hook_closure(uopz_hook_t *uhook) {
 	zend_fcall_info fci;
-	zend_fcall_info_cache fcc;
 	char *error = NULL;
-	zval closure, rv;
 
-	ZVAL_UNDEF(&rv);
+	if (EXPECTED(!Z_ISUNDEF(uhook->bound))) {
+		return;
+	}
 
-	uhook->busy = 1;
+	UOPZ_STAT(closures);
 
 #if PHP_VERSION_ID >= 80000
-	zend_create_closure(&closure, (zend_function*) zend_get_closure_method_def(Z_OBJ(uhook->closure)), 
+	zend_create_closure(&uhook->bound, (zend_function*) zend_get_closure_method_def(Z_OBJ(uhook->closure)), 
 #else
-	zend_create_closure(&closure, (zend_function*) zend_get_closure_method_def(&uhook->closure), 
+	zend_create_closure(&uhook->bound, (zend_function*) zend_get_closure_method_def(&uhook->closure), 
 #endif
-		uhook->clazz, uhook->clazz, Z_OBJ(EX(This)) ? &EX(This) : NULL);
-
-	zend_fcall_info_init(&closure, 0, &fci, &fcc, NULL, &error);
-
-	if (!skip) {
-        fci.param_count = ZEND_CALL_NUM_ARGS(execute_data);
-	    fci.params = ZEND_CALL_ARG(execute_data, 1);
-    } else {
-        if (variadic) {
-            zend_fcall_info_args_ex(
-                &fci,
-                fcc.function_handler,
-                ZEND_CALL_ARG(execute_data, 2));
-        } else {
-            fci.param_count = ZEND_CALL_NUM_ARGS(execute_data) - 1;
-	        fci.params = ZEND_CALL_ARG(execute_data, 2);
-        }
-    }
+		uhook->clazz, uhook->clazz, NULL);
+
+	zend_fcall_info_init(&uhook->bound, 0, &fci, &uhook->fcc, NULL, &error);
 
-	fci.retval= &rv;
+	if (error) {
+		efree(error);
+	}
+} /* }}} */
+
+void uopz_execute_hook(uopz_hook_t *uhook, zend_object *object, zval *params, uint32_t param_count) { /* {{{ */
+	zend_fcall_info fci = empty_fcall_info;
+	zend_fcall_info_cache fcc;
+	zval rv;
+	zend_long start = uopz_stats_clock();
+
+	ZVAL_UNDEF(&rv);
+
+	uhook->busy = 1;
+
+	uopz_hook_closure(uhook);
+
+	fcc = uhook->fcc;
+	fcc.object = object;
+
+	fci.size = sizeof(zend_fcall_info);
+	ZVAL_COPY_VALUE(&fci.function_name, &uhook->bound);
+	fci.object = object;
+#if PHP_VERSION_ID < 80000
+	fci.no_separation = 1;
+#endif
+
+	/* arguments are forwarded straight from the caller, never copied */
+	fci.params = params;
+	fci.param_count = param_count;
+	fci.retval = &rv;
+
+	UOPZ_STAT(calls);
+
+	/* the closure is the user's time, not ours */
+	uopz_stats_elapsed(start);
 	
 	if (zend_call_function(&fci, &fcc) == SUCCESS) {
 		if (!Z_ISUNDEF(rv)) {
@@ -200,20 +278,17 @@ void uopz_execute_hook(uopz_hook_t *uhook, zend_execute_data *execute_data, zend
 		}
 	}
 
-    if (variadic) {
-        zend_fcall_info_args_clear(&fci, 1);
-    }
-
-	zval_ptr_dtor(&closure);
-
 	uhook->busy = 0;
 } /* }}} */
 
 void uopz_hook_free(zval *zv) { /* {{{ */
 	uopz_hook_t *uhook = Z_PTR_P(zv);
 	
-	/*zend_string_release(uhook->function);*/
+	zend_string_release(uhook->function);
 	zval_ptr_dtor(&uhook->closure);
+	if (!Z_ISUNDEF(uhook->bound)) {
+		zval_ptr_dtor(&uhook->bound);
+	}
 	efree(uhook);
 } /* }}} */
 #endif	/* UOPZ_HOOK */
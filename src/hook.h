@@ -24,6 +24,8 @@ typedef struct _uopz_hook_t {
 	zend_class_entry *clazz;
 	zend_string *function;
 	zend_bool busy;
+	zval bound;
+	zend_fcall_info_cache fcc;
 } uopz_hook_t;
 
 zend_bool uopz_set_hook(zend_class_entry *clazz, zend_string *name, zval *closure);
@@ -31,7 +33,8 @@ zend_bool uopz_unset_hook(zend_class_entry *clazz, zend_string *function);
 void uopz_get_hook(zend_class_entry *clazz, zend_string *function, zval *return_value);
 
 uopz_hook_t* uopz_find_hook(zend_function *function);
-void uopz_execute_hook(uopz_hook_t *uhook, zend_execute_data *execute_data, zend_bool skip, zend_bool variadic);
+void uopz_hook_cache_flush(void);
+void uopz_execute_hook(uopz_hook_t *uhook, zend_object *object, zval *params, uint32_t param_count);
 
 void uopz_hook_free(zval *zv);
 #endif	/* UOPZ_HOOK_H */
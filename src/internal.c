@@ -0,0 +1,228 @@
+/*
+  +----------------------------------------------------------------------+
+  | uopz                                                                 |
+  +----------------------------------------------------------------------+
+  | Copyright (c) Joe Watkins 2016-2020                                  |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 3.01 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.php.net/license/3_01.txt                                  |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Joe Watkins <krakjoe@php.net>                                |
+  +----------------------------------------------------------------------+
+ */
+
+#ifndef UOPZ_INTERNAL
+#define UOPZ_INTERNAL
+
+#include "php.h"
+#include "uopz.h"
+
+#include "util.h"
+#include "return.h"
+#include "hook.h"
+#include "internal.h"
+
+ZEND_EXTERN_MODULE_GLOBALS(uopz);
+
+#if PHP_VERSION_ID < 70200
+typedef void (*zif_handler)(INTERNAL_FUNCTION_PARAMETERS);
+#endif
+
+#ifndef ZTS
+/* {{{ inherited copies of an internal method keep the name and scope of the original */
+static zend_always_inline zend_bool uopz_internal_copy(zend_function *function, zend_function *target) {
+	return target->type == ZEND_INTERNAL_FUNCTION &&
+		   target->common.scope == function->common.scope &&
+		   zend_string_equals_ci(target->common.function_name, function->common.function_name);
+} /* }}} */
+
+/* {{{ copies inherited after the handler was switched hold the trampoline without an entry of their own */
+static zif_handler uopz_internal_original(zend_function *function) {
+	zif_handler handler = (zif_handler)
+		zend_hash_index_find_ptr(&UOPZ(internals), (zend_ulong) function);
+	zend_ulong address;
+	void *original;
+
+	if (EXPECTED(handler)) {
+		return handler;
+	}
+
+	ZEND_HASH_FOREACH_NUM_KEY_PTR(&UOPZ(internals), address, original) {
+		if (uopz_internal_copy(function, (zend_function*) address)) {
+			return (zif_handler) original;
+		}
+	} ZEND_HASH_FOREACH_END();
+
+	return NULL;
+} /* }}} */
+
+/* {{{ stands in for the handler of an internal function with a hook or return */
+static ZEND_NAMED_FUNCTION(uopz_internal_trampoline) {
+	zend_function *function = EX(func);
+	zif_handler handler = uopz_internal_original(function);
+	uopz_hook_t *uhook = uopz_find_hook(function);
+	uopz_return_t *ureturn;
+
+	if (uhook && !uhook->busy) {
+		uopz_execute_hook(uhook,
+			Z_TYPE(EX(This)) == IS_OBJECT ? Z_OBJ(EX(This)) : NULL,
+			ZEND_CALL_ARG(execute_data, 1),
+			ZEND_CALL_NUM_ARGS(execute_data));
+	}
+
+	ureturn = uopz_find_return(function);
+
+	if (ureturn) {
+		if (!UOPZ_RETURN_IS_EXECUTABLE(ureturn)) {
+			UOPZ_STAT(calls);
+			ZVAL_COPY(return_value, &ureturn->value);
+			return;
+		}
+
+		if (!UOPZ_RETURN_IS_BUSY(ureturn)) {
+			uopz_execute_return(ureturn, execute_data, return_value);
+			return;
+		}
+	}
+
+	if (UNEXPECTED(!handler)) {
+		zend_throw_error(NULL,
+			"cannot call %s%s%s, uopz lost its handler",
+			function->common.scope ? ZSTR_VAL(function->common.scope->name) : "",
+			function->common.scope ? "::" : "",
+			ZSTR_VAL(function->common.function_name));
+		return;
+	}
+
+	handler(INTERNAL_FUNCTION_PARAM_PASSTHRU);
+} /* }}} */
+
+static void uopz_internal_switch(zend_function *function, zend_function *target, zif_handler handler) { /* {{{ */
+	if (!uopz_internal_copy(function, target) || 
+		target->internal_function.handler != handler) {
+		return;
+	}
+
+	zend_hash_index_update_ptr(&UOPZ(internals), (zend_ulong) target, (void*) handler);
+
+	target->internal_function.handler = uopz_internal_trampoline;
+} /* }}} */
+
+/* {{{ puts the original back in every copy holding the trampoline, user classes may have inherited copies since */
+static void uopz_internal_restore(zend_function *function, zif_handler original) {
+	zend_function *target;
+	zend_class_entry *ce;
+
+	ZEND_HASH_FOREACH_PTR(CG(class_table), ce) {
+		if (ce->type != ZEND_USER_CLASS) {
+			continue;
+		}
+
+		ZEND_HASH_FOREACH_PTR(&ce->function_table, target) {
+			if (target->type == ZEND_INTERNAL_FUNCTION &&
+				target->internal_function.handler == uopz_internal_trampoline &&
+				(!function || uopz_internal_copy(function, target))) {
+				target->internal_function.handler = original ? 
+					original : uopz_internal_original(target);
+			}
+		} ZEND_HASH_FOREACH_END();
+	} ZEND_HASH_FOREACH_END();
+} /* }}} */
+#endif
+
+void uopz_internal_attach(zend_function *function) { /* {{{ */
+#ifndef ZTS
+	zif_handler handler;
+	zend_function *target;
+	zend_class_entry *ce;
+
+	if (!function || 
+		function->type != ZEND_INTERNAL_FUNCTION ||
+		function->internal_function.handler == uopz_internal_trampoline) {
+		return;
+	}
+
+	handler = function->internal_function.handler;
+
+	if (!function->common.scope) {
+		ZEND_HASH_FOREACH_PTR(CG(function_table), target) {
+			uopz_internal_switch(function, target, handler);
+		} ZEND_HASH_FOREACH_END();
+
+		return;
+	}
+
+	ZEND_HASH_FOREACH_PTR(CG(class_table), ce) {
+		ZEND_HASH_FOREACH_PTR(&ce->function_table, target) {
+			uopz_internal_switch(function, target, handler);
+		} ZEND_HASH_FOREACH_END();
+	} ZEND_HASH_FOREACH_END();
+#endif
+} /* }}} */
+
+void uopz_internal_detach(zend_function *function) { /* {{{ */
+#ifndef ZTS
+	zend_ulong address;
+	zif_handler original;
+
+	if (!function || 
+		function->type != ZEND_INTERNAL_FUNCTION ||
+		function->internal_function.handler != uopz_internal_trampoline) {
+		return;
+	}
+
+	/* still needed by whichever of the hook or return remains */
+	if (uopz_find_hook(function) || uopz_find_return(function)) {
+		return;
+	}
+
+	if (!(original = uopz_internal_original(function))) {
+		return;
+	}
+
+	ZEND_HASH_FOREACH_NUM_KEY(&UOPZ(internals), address) {
+		zend_function *target = (zend_function*) address;
+
+		if (uopz_internal_copy(function, target)) {
+			target->internal_function.handler = original;
+
+			zend_hash_index_del(&UOPZ(internals), address);
+		}
+	} ZEND_HASH_FOREACH_END();
+
+	if (function->common.scope) {
+		uopz_internal_restore(function, original);
+	}
+#endif
+} /* }}} */
+
+void uopz_internal_shutdown(void) { /* {{{ */
+#ifndef ZTS
+	zend_ulong address;
+	void *handler;
+
+	uopz_internal_restore(NULL, NULL);
+
+	ZEND_HASH_FOREACH_NUM_KEY_PTR(&UOPZ(internals), address, handler) {
+		((zend_function*) address)->internal_function.handler = (zif_handler) handler;
+	} ZEND_HASH_FOREACH_END();
+#endif
+
+	zend_hash_destroy(&UOPZ(internals));
+} /* }}} */
+
+#endif	/* UOPZ_INTERNAL */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
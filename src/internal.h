@@ -0,0 +1,44 @@
+/*
+  +----------------------------------------------------------------------+
+  | uopz                                                                 |
+  +----------------------------------------------------------------------+
+  | Copyright (c) Joe Watkins 2016-2020                                  |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 3.01 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.php.net/license/3_01.txt                                  |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Joe Watkins <krakjoe@php.net>                                |
+  +----------------------------------------------------------------------+
+ */
+
+#ifndef UOPZ_INTERNAL_H
+#define UOPZ_INTERNAL_H
+
+/* {{{ internal functions are shared by every thread under ZTS, they are intercepted at the call there */
+static zend_always_inline zend_bool uopz_internal_trampolined(zend_function *function) {
+#ifdef ZTS
+	return 0;
+#else
+	return function->type == ZEND_INTERNAL_FUNCTION;
+#endif
+} /* }}} */
+
+void uopz_internal_attach(zend_function *function);
+void uopz_internal_detach(zend_function *function);
+void uopz_internal_shutdown(void);
+
+#endif	/* UOPZ_INTERNAL_H */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
@@ -0,0 +1,461 @@
+/*
+  +----------------------------------------------------------------------+
+  | uopz                                                                 |
+  +----------------------------------------------------------------------+
+  | Copyright (c) Joe Watkins 2016-2020                                  |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 3.01 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.php.net/license/3_01.txt                                  |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Joe Watkins <krakjoe@php.net>                                |
+  +----------------------------------------------------------------------+
+ */
+
+#ifndef UOPZ_JOURNAL
+#define UOPZ_JOURNAL
+
+#include "php.h"
+#include "uopz.h"
+
+#include "util.h"
+#include "return.h"
+#include "hook.h"
+#include "class.h"
+#include "constant.h"
+#include "function.h"
+#include "journal.h"
+
+ZEND_EXTERN_MODULE_GLOBALS(uopz);
+
+/* {{{ nothing is recorded unless a snapshot is outstanding, nothing else could be restored */
+static uopz_journal_t* uopz_journal_add(zend_uchar type, zend_class_entry *clazz, zend_string *name) {
+	uopz_journal_t entry;
+
+	if (EXPECTED(!zend_hash_num_elements(&UOPZ(snapshots)))) {
+		return NULL;
+	}
+
+	memset(&entry, 0, sizeof(uopz_journal_t));
+
+	entry.type = type;
+	entry.clazz = clazz;
+	entry.name = name ? zend_string_copy(name) : NULL;
+
+	ZVAL_UNDEF(&entry.value);
+	ZVAL_UNDEF(&entry.object);
+
+	return zend_hash_index_update_mem(&UOPZ(journal),
+		UOPZ(journaled)++, &entry, sizeof(uopz_journal_t));
+} /* }}} */
+
+void uopz_journal_free(zval *zv) { /* {{{ */
+	uopz_journal_t *entry = Z_PTR_P(zv);
+
+	if (entry->name) {
+		zend_string_release(entry->name);
+	}
+
+	zval_ptr_dtor(&entry->value);
+	zval_ptr_dtor(&entry->object);
+	efree(entry);
+} /* }}} */
+
+zend_long uopz_journal_mark(void) { /* {{{ */
+	return UOPZ(journaled);
+} /* }}} */
+
+/* {{{ changes are recorded from here on, until the snapshot is restored or released,
+	snapshots are never reused and map to the position in the journal they were taken at */
+zend_long uopz_journal_snapshot(void) {
+	zval position;
+
+	ZVAL_LONG(&position, UOPZ(journaled));
+
+	zend_hash_index_add_new(&UOPZ(snapshots), UOPZ(snapshotted), &position);
+
+	return UOPZ(snapshotted)++;
+} /* }}} */
+
+zend_bool uopz_journal_outstanding(zend_long snapshot) { /* {{{ */
+	return snapshot >= 0 && zend_hash_index_exists(&UOPZ(snapshots), snapshot);
+} /* }}} */
+
+/* {{{ entries older than the oldest outstanding snapshot can never be restored, they are dropped */
+void uopz_journal_release(zend_long snapshot) {
+	zend_long oldest = UOPZ(journaled);
+	zend_ulong position;
+	zval *taken;
+
+	zend_hash_index_del(&UOPZ(snapshots), snapshot);
+
+	ZEND_HASH_FOREACH_VAL(&UOPZ(snapshots), taken) {
+		if (Z_LVAL_P(taken) < oldest) {
+			oldest = Z_LVAL_P(taken);
+		}
+	} ZEND_HASH_FOREACH_END();
+
+	ZEND_HASH_FOREACH_NUM_KEY(&UOPZ(journal), position) {
+		if ((zend_long) position >= oldest) {
+			break;
+		}
+
+		zend_hash_index_del(&UOPZ(journal), position);
+	} ZEND_HASH_FOREACH_END();
+} /* }}} */
+
+/* {{{ a mutation that failed changed nothing, what was recorded for it is dropped */
+zend_bool uopz_journal_commit(zend_long mark, zend_bool result) {
+	if (result && !EG(exception)) {
+		return result;
+	}
+
+	while (UOPZ(journaled) > mark) {
+		zend_hash_index_del(&UOPZ(journal), --UOPZ(journaled));
+	}
+
+	return result;
+} /* }}} */
+
+static zval* uopz_journal_find(HashTable *registry, zend_class_entry *clazz, zend_string *name) { /* {{{ */
+	HashTable *table;
+
+	if (clazz) {
+		table = zend_hash_find_ptr(registry, clazz->name);
+	} else table = zend_hash_index_find_ptr(registry, 0);
+
+	if (!table) {
+		return NULL;
+	}
+
+	return uopz_hash_find_lc(table, name);
+} /* }}} */
+
+void uopz_journal_return(zend_class_entry *clazz, zend_string *name) { /* {{{ */
+	uopz_journal_t *entry = uopz_journal_add(UOPZ_JOURNAL_RETURN, clazz, name);
+	zval *found;
+
+	if (!entry) {
+		return;
+	}
+
+	if ((found = uopz_journal_find(&UOPZ(returns), clazz, name))) {
+		uopz_return_t *ureturn = Z_PTR_P(found);
+
+		ZVAL_COPY(&entry->value, &ureturn->value);
+
+		entry->flags = UOPZ_RETURN_IS_EXECUTABLE(ureturn);
+	}
+} /* }}} */
+
+void uopz_journal_hook(zend_class_entry *clazz, zend_string *name) { /* {{{ */
+	uopz_journal_t *entry = uopz_journal_add(UOPZ_JOURNAL_HOOK, clazz, name);
+	zval *found;
+
+	if (!entry) {
+		return;
+	}
+
+	if ((found = uopz_journal_find(&UOPZ(hooks), clazz, name))) {
+		ZVAL_COPY(&entry->value, &((uopz_hook_t*) Z_PTR_P(found))->closure);
+	}
+} /* }}} */
+
+void uopz_journal_mock(zend_string *name) { /* {{{ */
+	uopz_journal_t *entry = uopz_journal_add(UOPZ_JOURNAL_MOCK, NULL, name);
+	uopz_mock_t *mock;
+
+	if (!entry) {
+		return;
+	}
+
+	if ((mock = uopz_find_mock(name))) {
+		ZVAL_COPY(&entry->value, &mock->target);
+
+		entry->flags = mock->statics;
+	}
+} /* }}} */
+
+void uopz_journal_constant(zend_class_entry *clazz, zend_string *name) { /* {{{ */
+	uopz_journal_t *entry = uopz_journal_add(UOPZ_JOURNAL_CONSTANT, clazz, name);
+
+	if (!entry) {
+		return;
+	}
+
+	if (clazz) {
+		zend_class_constant *constant = zend_hash_find_ptr(&clazz->constants_table, name);
+
+		if (constant) {
+			ZVAL_COPY(&entry->value, &constant->value);
+		}
+	} else {
+		zval *constant = zend_get_constant(name);
+
+		if (constant) {
+			ZVAL_COPY(&entry->value, constant);
+		}
+	}
+} /* }}} */
+
+void uopz_journal_add_function(zend_class_entry *clazz, zend_string *name, zend_bool all) { /* {{{ */
+	uopz_journal_t *entry = uopz_journal_add(UOPZ_JOURNAL_ADD_FUNCTION, clazz, name);
+
+	if (!entry) {
+		return;
+	}
+
+	entry->all = all;
+} /* }}} */
+
+void uopz_journal_del_function(zend_class_entry *clazz, zend_string *name, zend_bool all) { /* {{{ */
+	HashTable *table = clazz ? &clazz->function_table : CG(function_table);
+	HashTable *functions = zend_hash_index_find_ptr(&UOPZ(functions), (zend_long) table);
+	uopz_journal_t *entry = uopz_journal_add(UOPZ_JOURNAL_DEL_FUNCTION, clazz, name);
+	zend_function *function;
+	zval *closure;
+
+	if (!entry) {
+		return;
+	}
+
+	entry->all = all;
+
+	if (!functions || !(closure = uopz_hash_find_lc(functions, name))) {
+		return;
+	}
+
+	ZVAL_COPY(&entry->value, closure);
+
+	if (uopz_find_function(table, name, &function) == SUCCESS) {
+		entry->flags = function->common.fn_flags & 
+			(ZEND_ACC_PPP_MASK|ZEND_ACC_STATIC|ZEND_ACC_FINAL);
+	}
+} /* }}} */
+
+void uopz_journal_replacement(zend_class_entry *clazz, zend_string *name) { /* {{{ */
+	HashTable *table = clazz ? &clazz->function_table : CG(function_table);
+	uopz_journal_t *entry = uopz_journal_add(UOPZ_JOURNAL_REPLACEMENT, clazz, name);
+	uopz_replacement_t *replacement;
+	zend_function *function;
+
+	if (!entry) {
+		return;
+	}
+
+	if (uopz_find_function(table, name, &function) != SUCCESS) {
+		return;
+	}
+
+	if ((replacement = zend_hash_index_find_ptr(&UOPZ(replacements), (zend_ulong) function))) {
+		ZVAL_COPY(&entry->value, &replacement->closure);
+	}
+} /* }}} */
+
+/* {{{ uopz_flags returns what it replaced, so this is recorded after the change */
+void uopz_journal_flags(zend_class_entry *clazz, zend_string *name, zend_long flags) {
+	uopz_journal_t *entry = uopz_journal_add(UOPZ_JOURNAL_FLAGS, clazz, name);
+
+	if (!entry) {
+		return;
+	}
+
+	entry->flags = flags;
+} /* }}} */
+
+void uopz_journal_statics(zend_class_entry *clazz, zend_string *name) { /* {{{ */
+	HashTable *table = clazz ? &clazz->function_table : CG(function_table);
+	uopz_journal_t *entry = uopz_journal_add(UOPZ_JOURNAL_STATICS, clazz, name);
+	zend_function *function;
+
+	if (!entry) {
+		return;
+	}
+
+	/* uopz_set_static raises the errors for functions without statics */
+	if (uopz_find_function(table, name, &function) == SUCCESS &&
+		function->type == ZEND_USER_FUNCTION && function->op_array.static_variables) {
+		uopz_get_static(clazz, name, &entry->value);
+	}
+} /* }}} */
+
+void uopz_journal_property(zval *object, zend_class_entry *clazz, zend_string *name) { /* {{{ */
+	uopz_journal_t *entry = uopz_journal_add(UOPZ_JOURNAL_PROPERTY, clazz, name);
+	int reporting = EG(error_reporting);
+
+	if (!entry) {
+		return;
+	}
+
+	/* a property that did not exist is restored as null, without a notice now */
+	EG(error_reporting) = 0;
+
+	if (object) {
+		zval member;
+
+		ZVAL_STR(&member, name);
+		ZVAL_COPY(&entry->object, object);
+
+		uopz_get_property(object, &member, &entry->value);
+	} else {
+		uopz_get_static_property(clazz, name, &entry->value);
+	}
+
+	EG(error_reporting) = reporting;
+} /* }}} */
+
+void uopz_journal_exit(void) { /* {{{ */
+	uopz_journal_t *entry = uopz_journal_add(UOPZ_JOURNAL_EXIT, NULL, NULL);
+
+	if (!entry) {
+		return;
+	}
+
+	entry->flags = UOPZ(exit);
+} /* }}} */
+
+/* {{{ puts back what was in place before the entry was recorded */
+static void uopz_journal_undo(uopz_journal_t *entry) {
+	zval rv;
+
+	switch (entry->type) {
+		case UOPZ_JOURNAL_RETURN:
+			if (Z_TYPE(entry->value) != IS_UNDEF) {
+				uopz_set_return(entry->clazz, entry->name, &entry->value, entry->flags);
+			} else if (uopz_journal_find(&UOPZ(returns), entry->clazz, entry->name)) {
+				uopz_unset_return(entry->clazz, entry->name);
+			}
+		break;
+
+		case UOPZ_JOURNAL_HOOK:
+			if (Z_TYPE(entry->value) != IS_UNDEF) {
+				uopz_set_hook(entry->clazz, entry->name, &entry->value);
+			} else if (uopz_journal_find(&UOPZ(hooks), entry->clazz, entry->name)) {
+				uopz_unset_hook(entry->clazz, entry->name);
+			}
+		break;
+
+		case UOPZ_JOURNAL_MOCK:
+			if (Z_TYPE(entry->value) != IS_UNDEF) {
+				uopz_set_mock(entry->name, &entry->value, entry->flags);
+			} else if (uopz_find_mock(entry->name)) {
+				uopz_unset_mock(entry->name);
+			}
+		break;
+
+		case UOPZ_JOURNAL_CONSTANT:
+			if (Z_TYPE(entry->value) != IS_UNDEF) {
+				uopz_constant_redefine(entry->clazz, entry->name, &entry->value);
+			} else {
+				uopz_constant_undefine(entry->clazz, entry->name);
+			}
+		break;
+
+		case UOPZ_JOURNAL_ADD_FUNCTION:
+			uopz_del_function(entry->clazz, entry->name, entry->all);
+		break;
+
+		case UOPZ_JOURNAL_DEL_FUNCTION:
+			if (Z_TYPE(entry->value) != IS_UNDEF) {
+				uopz_add_function(entry->clazz, entry->name, &entry->value, entry->flags, entry->all);
+			}
+		break;
+
+		case UOPZ_JOURNAL_REPLACEMENT:
+			if (Z_TYPE(entry->value) != IS_UNDEF) {
+				uopz_replace_function(entry->clazz, entry->name, &entry->value);
+			} else {
+				uopz_restore_function(entry->clazz, entry->name);
+			}
+		break;
+
+		case UOPZ_JOURNAL_FLAGS:
+			ZVAL_UNDEF(&rv);
+			uopz_flags(entry->clazz, entry->name, entry->flags, &rv);
+		break;
+
+		case UOPZ_JOURNAL_STATICS:
+			if (Z_TYPE(entry->value) == IS_ARRAY) {
+				uopz_set_static(entry->clazz, entry->name, &entry->value);
+			}
+		break;
+
+		case UOPZ_JOURNAL_PROPERTY:
+			if (Z_TYPE(entry->value) == IS_UNDEF) {
+				ZVAL_NULL(&entry->value);
+			}
+
+			if (Z_TYPE(entry->object) != IS_UNDEF) {
+				zval member;
+
+				ZVAL_STR(&member, entry->name);
+
+				uopz_set_property(&entry->object, &member, &entry->value);
+			} else {
+				uopz_set_static_property(entry->clazz, entry->name, &entry->value);
+			}
+		break;
+
+		case UOPZ_JOURNAL_EXIT:
+			UOPZ(exit) = entry->flags;
+		break;
+	}
+} /* }}} */
+
+/* {{{ undo every change recorded since snapshot newest first, call sites move on once */
+zend_bool uopz_journal_rewind(zend_long snapshot) {
+	zend_bool rewound = 1;
+	zend_ulong position;
+	zend_long mark;
+	uopz_journal_t *entry;
+	zval *taken = zend_hash_index_find(&UOPZ(snapshots), snapshot);
+
+	if (!taken) {
+		return 0;
+	}
+
+	mark = Z_LVAL_P(taken);
+
+	/* snapshots taken since are restored past */
+	ZEND_HASH_FOREACH_NUM_KEY(&UOPZ(snapshots), position) {
+		if ((zend_long) position > snapshot) {
+			zend_hash_index_del(&UOPZ(snapshots), position);
+		}
+	} ZEND_HASH_FOREACH_END();
+
+	uopz_batch_begin();
+
+	while (UOPZ(journaled) > mark) {
+		position = --UOPZ(journaled);
+
+		if ((entry = zend_hash_index_find_ptr(&UOPZ(journal), position))) {
+			uopz_journal_undo(entry);
+		}
+
+		zend_hash_index_del(&UOPZ(journal), position);
+
+		if (EG(exception)) {
+			rewound = 0;
+			break;
+		}
+	}
+
+	uopz_batch_end();
+
+	return rewound;
+} /* }}} */
+
+#endif	/* UOPZ_JOURNAL */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
@@ -0,0 +1,77 @@
+/*
+  +----------------------------------------------------------------------+
+  | uopz                                                                 |
+  +----------------------------------------------------------------------+
+  | Copyright (c) Joe Watkins 2016-2020                                  |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 3.01 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.php.net/license/3_01.txt                                  |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Joe Watkins <krakjoe@php.net>                                |
+  +----------------------------------------------------------------------+
+ */
+
+#ifndef UOPZ_JOURNAL_H
+#define UOPZ_JOURNAL_H
+
+typedef enum _uopz_journal_type_t {
+	UOPZ_JOURNAL_RETURN,
+	UOPZ_JOURNAL_HOOK,
+	UOPZ_JOURNAL_MOCK,
+	UOPZ_JOURNAL_CONSTANT,
+	UOPZ_JOURNAL_ADD_FUNCTION,
+	UOPZ_JOURNAL_DEL_FUNCTION,
+	UOPZ_JOURNAL_REPLACEMENT,
+	UOPZ_JOURNAL_FLAGS,
+	UOPZ_JOURNAL_STATICS,
+	UOPZ_JOURNAL_PROPERTY,
+	UOPZ_JOURNAL_EXIT,
+} uopz_journal_type_t;
+
+/* what was in place before a mutation, value is UNDEF when nothing was */
+typedef struct _uopz_journal_t {
+	zend_uchar        type;
+	zend_class_entry *clazz;
+	zend_string      *name;
+	zval              value;
+	zval              object;
+	zend_long         flags;
+	zend_bool         all;
+} uopz_journal_t;
+
+zend_long uopz_journal_mark(void);
+zend_long uopz_journal_snapshot(void);
+zend_bool uopz_journal_outstanding(zend_long snapshot);
+void uopz_journal_release(zend_long snapshot);
+zend_bool uopz_journal_commit(zend_long mark, zend_bool result);
+zend_bool uopz_journal_rewind(zend_long snapshot);
+
+void uopz_journal_return(zend_class_entry *clazz, zend_string *name);
+void uopz_journal_hook(zend_class_entry *clazz, zend_string *name);
+void uopz_journal_mock(zend_string *name);
+void uopz_journal_constant(zend_class_entry *clazz, zend_string *name);
+void uopz_journal_add_function(zend_class_entry *clazz, zend_string *name, zend_bool all);
+void uopz_journal_del_function(zend_class_entry *clazz, zend_string *name, zend_bool all);
+void uopz_journal_replacement(zend_class_entry *clazz, zend_string *name);
+void uopz_journal_flags(zend_class_entry *clazz, zend_string *name, zend_long flags);
+void uopz_journal_statics(zend_class_entry *clazz, zend_string *name);
+void uopz_journal_property(zval *object, zend_class_entry *clazz, zend_string *name);
+void uopz_journal_exit(void);
+
+void uopz_journal_free(zval *zv);
+
+#endif	/* UOPZ_JOURNAL_H */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
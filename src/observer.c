@@ -0,0 +1,103 @@
+/*
+  +----------------------------------------------------------------------+
+  | uopz                                                                 |
+  +----------------------------------------------------------------------+
+  | Copyright (c) Joe Watkins 2016-2020                                  |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 3.01 of the PHP license,      |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.php.net/license/3_01.txt                                  |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Joe Watkins <krakjoe@php.net>                                |
+  +----------------------------------------------------------------------+
+ */
+
+#ifndef UOPZ_OBSERVER
+#define UOPZ_OBSERVER
+
+#include "php.h"
+#include "uopz.h"
+
+#include "util.h"
+#include "hook.h"
+#include "observer.h"
+
+#if PHP_VERSION_ID >= 80000
+#include "Zend/zend_observer.h"
+#endif
+
+ZEND_EXTERN_MODULE_GLOBALS(uopz);
+
+#if PHP_VERSION_ID >= 80000
+/* {{{ */
+static void uopz_observer_begin(zend_execute_data *execute_data) {
+	uopz_hook_t *uhook = uopz_find_hook(EX(func));
+	zval *params;
+
+	if (!uhook || uhook->busy) {
+		return;
+	}
+
+	params = uopz_received_args(execute_data);
+
+	uopz_execute_hook(uhook,
+		Z_TYPE(EX(This)) == IS_OBJECT ? Z_OBJ(EX(This)) : NULL,
+		params, ZEND_CALL_NUM_ARGS(execute_data));
+
+	uopz_received_args_free(execute_data, params);
+} /* }}} */
+
+/* {{{ functions without a hook are left unobserved */
+static zend_observer_fcall_handlers uopz_observer_fcall_init(zend_execute_data *execute_data) {
+	zend_observer_fcall_handlers handlers = {NULL, NULL};
+
+	if (uopz_find_hook(EX(func))) {
+		handlers.begin = uopz_observer_begin;
+	}
+
+	return handlers;
+} /* }}} */
+
+/* {{{ */
+static void uopz_observer_reset_function(zend_function *function, void *arg) {
+	if (function->type != ZEND_USER_FUNCTION) {
+		return;
+	}
+
+	if (RUN_TIME_CACHE(&function->op_array)) {
+		ZEND_OBSERVER_DATA(&function->op_array) = NULL;
+	}
+} /* }}} */
+#endif
+
+void uopz_observer_init(void) { /* {{{ */
+#if PHP_VERSION_ID >= 80000
+	zend_observer_fcall_register(uopz_observer_fcall_init);
+#endif
+} /* }}} */
+
+/* {{{ observer handlers are decided once per function, make the engine ask again for function and its copies */
+void uopz_observer_reset(zend_function *function) {
+#if PHP_VERSION_ID >= 80000
+	if (!UOPZ(observer) || !function) {
+		return;
+	}
+
+	uopz_function_copies(function, uopz_observer_reset_function, NULL);
+#endif
+} /* }}} */
+
+#endif	/* UOPZ_OBSERVER */
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noet sw=4 ts=4 fdm=marker
+ * vim<600: noet sw=4 ts=4
+ */
@@ -24,16 +24,160 @@
 
 #include "util.h"
 #include "return.h"
+#include "internal.h"
 
 #include <Zend/zend_closures.h>
 
 ZEND_EXTERN_MODULE_GLOBALS(uopz);
 
+/* {{{ constant returns on plain user functions are compiled into the callee */
+static zend_bool uopz_return_patchable(zend_function *function) {
+	if (function->type != ZEND_USER_FUNCTION) {
+		return 0;
+	}
+
+	if (function->common.fn_flags & (ZEND_ACC_GENERATOR|ZEND_ACC_RETURN_REFERENCE|ZEND_ACC_ABSTRACT|ZEND_ACC_CLOSURE|ZEND_ACC_CALL_VIA_TRAMPOLINE)) {
+		return 0;
+	}
+
+#if PHP_VERSION_ID >= 70400
+	if (function->common.fn_flags & ZEND_ACC_IMMUTABLE) {
+		return 0;
+	}
+#endif
+
+	/* an active frame still needs the original try/catch and live ranges */
+	return !uopz_function_active(function);
+} /* }}} */
+
+/* {{{ */
+static void uopz_return_patch_function(zend_function *function, uopz_return_patch_t *patch, zend_bool restore) {
+	zend_op_array *op_array;
+
+	if (function->type != ZEND_USER_FUNCTION) {
+		return;
+	}
+
+	op_array = &function->op_array;
+
+	if (restore) {
+		if (op_array->opcodes != patch->stub) {
+			return;
+		}
+
+		op_array->opcodes = patch->opcodes;
+		op_array->last = patch->last;
+		op_array->literals = patch->literals;
+		op_array->last_literal = patch->last_literal;
+		op_array->live_range = patch->live_range;
+		op_array->last_live_range = patch->last_live_range;
+		op_array->try_catch_array = patch->try_catch_array;
+		op_array->last_try_catch = patch->last_try_catch;
+	} else {
+		if (op_array->opcodes != patch->opcodes) {
+			return;
+		}
+
+		op_array->opcodes = patch->stub;
+		op_array->last = op_array->num_args + 1;
+		op_array->literals = patch->literal;
+		op_array->last_literal = 1;
+		op_array->live_range = NULL;
+		op_array->last_live_range = 0;
+		op_array->try_catch_array = NULL;
+		op_array->last_try_catch = 0;
+	}
+} /* }}} */
+
+static void uopz_return_patch_copy(zend_function *function, void *patch) { /* {{{ */
+	uopz_return_patch_function(function, patch, 0);
+} /* }}} */
+
+static void uopz_return_restore_copy(zend_function *function, void *patch) { /* {{{ */
+	uopz_return_patch_function(function, patch, 1);
+} /* }}} */
+
+/* {{{ inherited copies share opcodes with the original, every copy is switched */
+static void uopz_return_patch_apply(uopz_return_patch_t *patch, zend_bool restore) {
+	uopz_function_copies(patch->function, 
+		restore ? uopz_return_restore_copy : uopz_return_patch_copy, patch);
+} /* }}} */
+
+/* {{{ the body becomes a NOP for each skippable RECV followed by RETURN <literal> */
+static void uopz_return_patch(uopz_return_t *ureturn, zend_function *function) {
+	zend_op_array *op_array = &function->op_array;
+	uopz_return_patch_t *patch;
+	uint32_t last = op_array->num_args + 1, it;
+	zend_op *opline;
+
+	patch = emalloc(sizeof(uopz_return_patch_t));
+	patch->function = function;
+	patch->stub = emalloc(sizeof(zend_op) * last + sizeof(zval));
+	patch->last = op_array->last;
+	patch->opcodes = op_array->opcodes;
+	patch->literals = op_array->literals;
+	patch->last_literal = op_array->last_literal;
+	patch->live_range = op_array->live_range;
+	patch->last_live_range = op_array->last_live_range;
+	patch->try_catch_array = op_array->try_catch_array;
+	patch->last_try_catch = op_array->last_try_catch;
+
+	memset(patch->stub, 0, sizeof(zend_op) * last);
+
+	patch->literal = (zval*) (patch->stub + last);
+	ZVAL_COPY(patch->literal, &ureturn->value);
+
+	uopz_return_patch_function(function, patch, 0);
+
+	for (it = 0; it < last; it++) {
+		opline = &patch->stub[it];
+		opline->lineno = op_array->line_start;
+
+		if (it < last - 1) {
+			opline->opcode = ZEND_NOP;
+		} else {
+			opline->opcode = ZEND_RETURN;
+			opline->op1_type = IS_CONST;
+			opline->op1.constant = 0;
+			opline->result.num = UOPZ_RETURN_STUB;
+#if PHP_VERSION_ID >= 70300
+			ZEND_PASS_TWO_UPDATE_CONSTANT(op_array, opline, opline->op1);
+#else
+			ZEND_PASS_TWO_UPDATE_CONSTANT(op_array, opline->op1);
+#endif
+		}
+
+		zend_vm_set_opcode_handler(opline);
+	}
+
+	uopz_return_patch_apply(patch, 0);
+
+	ureturn->patch = patch;
+
+	UOPZ(patches)++;
+} /* }}} */
+
+/* {{{ */
+static void uopz_return_restore(uopz_return_t *ureturn) {
+	uopz_return_patch_t *patch = ureturn->patch;
+
+	uopz_return_patch_apply(patch, 1);
+
+	zval_ptr_dtor(patch->literal);
+	efree(patch->stub);
+	efree(patch);
+
+	ureturn->patch = NULL;
+
+	UOPZ(patches)--;
+} /* }}} */
+
 zend_bool uopz_set_return(zend_class_entry *clazz, zend_string *name, zval *value, zend_bool execute) { /* {{{ */
 	HashTable *returns;
-	uopz_return_t ret;
+	uopz_return_t ret, *stored;
 	zend_string *key = zend_string_tolower(name);
-	zend_function *function;
+	zend_function *function = NULL;
+	zend_bool patch;
 
 	if (clazz) {
 		if (uopz_find_method(clazz, key, &function) != SUCCESS) {
@@ -41,7 +185,7 @@ zend_bool uopz_set_return(zend_class_entry *clazz, zend_string *name, zval *valu
 				"failed to set return for %s::%s, the method does not exist",
 				ZSTR_VAL(clazz->name),
 				ZSTR_VAL(name));
-			/*zend_string_release(key);*/
+			zend_string_release(key);
 			return 0;
 		}
 
@@ -51,9 +195,23 @@ zend_bool uopz_set_return(zend_class_entry *clazz, zend_string *name, zval *valu
 				ZSTR_VAL(clazz->name),
 				ZSTR_VAL(name),
 				ZSTR_VAL(function->common.scope->name));
-			/*zend_string_release(key);*/
+			zend_string_release(key);
 			return 0;
 		}
+	} else if (uopz_find_function(CG(function_table), key, &function) != SUCCESS) {
+		function = NULL;
+	}
+
+	patch = !execute && function && uopz_return_patchable(function);
+
+	if (UOPZ(observer) && !patch && !(function && uopz_internal_trampolined(function))) {
+		uopz_exception(
+			"failed to set return for %s%s%s, the observer backend only supports constant returns for user functions",
+			clazz ? ZSTR_VAL(clazz->name) : "",
+			clazz ? "::" : "",
+			ZSTR_VAL(name));
+		zend_string_release(key);
+		return 0;
 	}
 
 	if (clazz) {
@@ -75,34 +233,63 @@ zend_bool uopz_set_return(zend_class_entry *clazz, zend_string *name, zval *valu
 	ZVAL_COPY(&ret.value, value);
 	ret.flags = execute ? UOPZ_RETURN_EXECUTE : 0;
 
-	zend_hash_update_mem(returns, key, &ret, sizeof(uopz_return_t));
+	if ((stored = zend_hash_find_ptr(returns, key)) && !UOPZ_RETURN_IS_PATCHED(stored)) {
+		UOPZ(intercepts)--;
+	}
+
+	stored = zend_hash_update_mem(returns, key, &ret, sizeof(uopz_return_t));
+
+	/* patched returns never need the call to be intercepted */
+	if (patch) {
+		uopz_return_patch(stored, function);
+	} else {
+		UOPZ(intercepts)++;
+	}
 
-	/*zend_string_release(key);*/
+	uopz_return_cache_flush();
+	uopz_internal_attach(function);
+
+	zend_string_release(key);
 	return 1;
 } /* }}} */
 
 zend_bool uopz_unset_return(zend_class_entry *clazz, zend_string *function) { /* {{{ */
 	HashTable *returns;
+	uopz_return_t *ureturn;
 	zend_string *key = zend_string_tolower(function);
+	zend_function *internal = NULL;
 	
 	if (clazz) {
 		returns = zend_hash_find_ptr(&UOPZ(returns), clazz->name);
 	} else returns = zend_hash_index_find_ptr(&UOPZ(returns), 0);
 
-	if (!returns || !zend_hash_exists(returns, key)) {
-		/*zend_string_release(key);*/
+	if (!returns || !(ureturn = zend_hash_find_ptr(returns, key))) {
+		zend_string_release(key);
 		return 0;
 	}
 
+	if (!UOPZ_RETURN_IS_PATCHED(ureturn)) {
+		UOPZ(intercepts)--;
+	}
+
 	zend_hash_del(returns, key);
-	/*zend_string_release(key);*/
+
+	uopz_return_cache_flush();
+
+	if (clazz) {
+		uopz_find_method(clazz, key, &internal);
+	} else uopz_find_function(CG(function_table), key, &internal);
+
+	uopz_internal_detach(internal);
+
+	zend_string_release(key);
 
 	return 1;
 } /* }}} */
 
 void uopz_get_return(zend_class_entry *clazz, zend_string *function, zval *return_value) { /* {{{ */
 	HashTable *returns;
-	uopz_return_t *ureturn;
+	zval *ureturn;
 
 	if (clazz) {
 		returns = zend_hash_find_ptr(&UOPZ(returns), clazz->name);
@@ -112,28 +299,20 @@ void uopz_get_return(zend_class_entry *clazz, zend_string *function, zval *retur
 		return;
 	}
 
-	ureturn = zend_hash_find_ptr(returns, function);
+	ureturn = uopz_hash_find_lc(returns, function);
 
 	if (!ureturn) {
 		return;
 	}
 	
-	ZVAL_COPY(return_value, &ureturn->value);
+	ZVAL_COPY(return_value, &((uopz_return_t*) Z_PTR_P(ureturn))->value);
 } /* }}} */
 
-uopz_return_t* uopz_find_return(zend_function *function) { /* {{{ */
-	zend_string *key;
+static uopz_return_t* uopz_resolve_return(zend_function *function) { /* {{{ */
+	zval *found;
 	uopz_return_t *ureturn;
 	HashTable *returns;
 
-	if (!function) {
-        return NULL;
-    }
-
-	if (function->common.fn_flags & ZEND_ACC_CLOSURE) {
-		return NULL;
-	}
-
 	if (!function->common.function_name) {
 		return NULL;
 	}
@@ -148,55 +327,140 @@ uopz_return_t* uopz_find_return(zend_function *function) { /* {{{ */
 		if (function->common.prototype && 
 		    function->common.prototype->common.scope &&
 		    function->common.prototype->common.scope->ce_flags & ZEND_ACC_INTERFACE) {
-			return uopz_find_return(
+			return uopz_resolve_return(
 				function->common.prototype);
 		}
 
 		return NULL;
 	}
 
-	key = zend_string_tolower(function->common.function_name);
-	ureturn = zend_hash_find_ptr(returns, key);
-	/*zend_string_release(key);*/
+	found = uopz_hash_find_lc(returns, function->common.function_name);
+	ureturn = found ? Z_PTR_P(found) : NULL;
+
+	return ureturn;
+} /* }}} */
+
+uopz_return_t* uopz_find_return(zend_function *function) { /* {{{ */
+	uopz_return_t *ureturn;
+	zval *cached;
+	zend_long start;
+
+	if (!function) {
+		return NULL;
+	}
+
+	if (function->common.fn_flags & ZEND_ACC_CLOSURE) {
+		return NULL;
+	}
+
+	UOPZ_STAT(lookups);
+	start = uopz_stats_clock();
+
+	/* the trampoline is shared by every magic call, it cannot be cached */
+	if (function->common.fn_flags & ZEND_ACC_CALL_VIA_TRAMPOLINE) {
+		ureturn = uopz_resolve_return(function);
+	} else if ((cached = zend_hash_index_find(&UOPZ(rcache), (zend_ulong) function))) {
+		ureturn = Z_PTR_P(cached);
+	} else {
+		ureturn = uopz_resolve_return(function);
+
+		zend_hash_index_add_new_ptr(
+			&UOPZ(rcache), (zend_ulong) function, ureturn);
+	}
+
+	if (ureturn) {
+		UOPZ_STAT(hits);
+	}
+
+	uopz_stats_elapsed(start);
 
 	return ureturn;
 } /* }}} */
 
+void uopz_return_cache_flush(void) { /* {{{ */
+	zend_hash_clean(&UOPZ(rcache));
+	zend_hash_clean(&UOPZ(sites));
+} /* }}} */
+
+void uopz_site_free(zval *zv) { /* {{{ */
+	efree(Z_PTR_P(zv));
+} /* }}} */
+
+/* {{{ a patched function about to be destroyed goes back to being intercepted */
+void uopz_return_unpatch(zend_function *function) {
+	uopz_return_t *ureturn = uopz_find_return(function);
+
+	if (!ureturn || !UOPZ_RETURN_IS_PATCHED(ureturn)) {
+		return;
+	}
+
+	if (function->op_array.opcodes != ureturn->patch->stub) {
+		return;
+	}
+
+	uopz_return_restore(ureturn);
+
+	UOPZ(intercepts)++;
+} /* }}} */
+
 extern PHP_FUNCTION(php_call_user_func);
 
-void uopz_execute_return(uopz_return_t *ureturn, zend_execute_data *execute_data, zval *return_value) { /* {{{ */
-	zend_fcall_info fci = empty_fcall_info;
-	zend_fcall_info_cache fcc = empty_fcall_info_cache;
+/* {{{ the closure is bound to the scope once, $this is supplied per call */
+static zend_always_inline void uopz_return_closure(uopz_return_t *ureturn) {
+	zend_fcall_info fci;
 	char *error = NULL;
-	zval closure, 
-		 rv,
-		 *result = return_value ? return_value : &rv;
 
-	ZVAL_UNDEF(&rv);
+	if (EXPECTED(!Z_ISUNDEF(ureturn->closure))) {
+		return;
+	}
 
-	ureturn->flags ^= UOPZ_RETURN_BUSY;
+	UOPZ_STAT(closures);
 
 #if PHP_VERSION_ID >= 80000
-	zend_create_closure(&closure, (zend_function*) zend_get_closure_method_def(Z_OBJ(ureturn->value)), 
+	zend_create_closure(&ureturn->closure, (zend_function*) zend_get_closure_method_def(Z_OBJ(ureturn->value)), 
 #else
-	zend_create_closure(&closure, (zend_function*) zend_get_closure_method_def(&ureturn->value), 
+	zend_create_closure(&ureturn->closure, (zend_function*) zend_get_closure_method_def(&ureturn->value), 
 #endif
-		ureturn->clazz, ureturn->clazz, Z_OBJ(EX(This)) ? &EX(This) : NULL);
+		ureturn->clazz, ureturn->clazz, NULL);
 
-	zend_fcall_info_init(&closure, 0, &fci, &fcc, NULL, &error);
+	zend_fcall_info_init(&ureturn->closure, 0, &fci, &ureturn->fcc, NULL, &error);
 
-	if (uopz_is_cuf(execute_data)) {
-		fci.params = ZEND_CALL_ARG(execute_data, 2);
-		fci.param_count = ZEND_CALL_NUM_ARGS(execute_data) - 1;
-	} else if (uopz_is_cufa(execute_data)) {
-		zend_fcall_info_args(&fci, ZEND_CALL_ARG(execute_data, 2));
-	} else {
-		fci.params = ZEND_CALL_ARG(execute_data, 1);
-		fci.param_count = ZEND_CALL_NUM_ARGS(execute_data);
+	if (error) {
+		efree(error);
 	}
+} /* }}} */
+
+void uopz_execute_return_args(uopz_return_t *ureturn, zend_object *object, zval *params, uint32_t param_count, zval *return_value) { /* {{{ */
+	zend_fcall_info fci = empty_fcall_info;
+	zend_fcall_info_cache fcc;
+	zval rv,
+		 *result = return_value ? return_value : &rv;
+	zend_long start = uopz_stats_clock();
+
+	ZVAL_UNDEF(&rv);
+
+	ureturn->flags ^= UOPZ_RETURN_BUSY;
+
+	uopz_return_closure(ureturn);
+
+	fcc = ureturn->fcc;
+	fcc.object = object;
 
+	fci.size = sizeof(zend_fcall_info);
+	ZVAL_COPY_VALUE(&fci.function_name, &ureturn->closure);
+	fci.object = object;
+#if PHP_VERSION_ID < 80000
+	fci.no_separation = 1;
+#endif
+	fci.params = params;
+	fci.param_count = param_count;
 	fci.retval = result;
 
+	UOPZ_STAT(calls);
+
+	/* the closure is the user's time, not ours */
+	uopz_stats_elapsed(start);
+
 	if (zend_call_function(&fci, &fcc) == SUCCESS) {
 		if (!return_value) {
 			if (!Z_ISUNDEF(rv)) {
@@ -205,16 +469,41 @@ void uopz_execute_return(uopz_return_t *ureturn, zend_execute_data *execute_data
 		}
 	}
 
-	zval_ptr_dtor(&closure);
-
 	ureturn->flags ^= UOPZ_RETURN_BUSY;
 } /* }}} */
 
+void uopz_execute_return(uopz_return_t *ureturn, zend_execute_data *execute_data, zval *return_value) { /* {{{ */
+	zend_object *object = Z_TYPE(EX(This)) == IS_OBJECT ? Z_OBJ(EX(This)) : NULL;
+
+	if (uopz_is_cuf(execute_data)) {
+		uopz_execute_return_args(ureturn, object, 
+			ZEND_CALL_ARG(execute_data, 2), ZEND_CALL_NUM_ARGS(execute_data) - 1, return_value);
+	} else if (uopz_is_cufa(execute_data)) {
+		zend_fcall_info fci = empty_fcall_info;
+
+		zend_fcall_info_args(&fci, ZEND_CALL_ARG(execute_data, 2));
+
+		uopz_execute_return_args(ureturn, object, 
+			fci.params, fci.param_count, return_value);
+
+		zend_fcall_info_args_clear(&fci, 1);
+	} else {
+		uopz_execute_return_args(ureturn, object, 
+			ZEND_CALL_ARG(execute_data, 1), ZEND_CALL_NUM_ARGS(execute_data), return_value);
+	}
+} /* }}} */
+
 void uopz_return_free(zval *zv) { /* {{{ */
 	uopz_return_t *ureturn = Z_PTR_P(zv);
 	
-	/*zend_string_release(ureturn->function);*/
+	zend_string_release(ureturn->function);
+	if (UOPZ_RETURN_IS_PATCHED(ureturn)) {
+		uopz_return_restore(ureturn);
+	}
 	zval_ptr_dtor(&ureturn->value);
+	if (!Z_ISUNDEF(ureturn->closure)) {
+		zval_ptr_dtor(&ureturn->closure);
+	}
 	efree(ureturn);
 } /* }}} */
 
@@ -19,25 +19,62 @@
 #ifndef UOPZ_RETURN_H
 #define UOPZ_RETURN_H
 
+typedef struct _uopz_return_patch_t {
+	zend_function *function;
+	zend_op *stub;
+	zval *literal;
+	uint32_t last;
+	zend_op *opcodes;
+	zval *literals;
+	int last_literal;
+	zend_live_range *live_range;
+	int last_live_range;
+	zend_try_catch_element *try_catch_array;
+	int last_try_catch;
+} uopz_return_patch_t;
+
 typedef struct _uopz_return_t {
 	zval value;
 	zend_uchar flags;
 	zend_class_entry *clazz;
 	zend_string *function;
+	zval closure;
+	zend_fcall_info_cache fcc;
+	uopz_return_patch_t *patch;
 } uopz_return_t;
 
+/* a call site memoized by uopz.specialize */
+typedef struct _uopz_site_t {
+	zend_function *function;
+	uopz_return_t *ureturn;
+} uopz_site_t;
+
 #define UOPZ_RETURN_EXECUTE 0x00000001
 #define UOPZ_RETURN_BUSY	0x00000010
 
 #define UOPZ_RETURN_IS_EXECUTABLE(u) (((u)->flags & UOPZ_RETURN_EXECUTE) == UOPZ_RETURN_EXECUTE)
 #define UOPZ_RETURN_IS_BUSY(u) (((u)->flags & UOPZ_RETURN_BUSY) == UOPZ_RETURN_BUSY)
+#define UOPZ_RETURN_IS_PATCHED(u) ((u)->patch != NULL)
+
+/* the RETURN of a patch stub carries this in its unused result */
+#define UOPZ_RETURN_STUB ((uint32_t) -2)
+
+/* {{{ a patched function runs nothing but its stub */
+static zend_always_inline zend_bool uopz_return_stub(zend_function *function) {
+	return function->type == ZEND_USER_FUNCTION &&
+		   function->op_array.opcodes[function->op_array.last - 1].result.num == UOPZ_RETURN_STUB;
+} /* }}} */
 
 zend_bool uopz_set_return(zend_class_entry *clazz, zend_string *name, zval *value, zend_bool execute);
 zend_bool uopz_unset_return(zend_class_entry *clazz, zend_string *function);
 void uopz_get_return(zend_class_entry *clazz, zend_string *function, zval *return_value);
 
 uopz_return_t* uopz_find_return(zend_function *function);
+void uopz_return_cache_flush(void);
+void uopz_return_unpatch(zend_function *function);
+void uopz_site_free(zval *zv);
 void uopz_execute_return(uopz_return_t *ureturn, zend_execute_data *execute_data, zval *return_value);
+void uopz_execute_return_args(uopz_return_t *ureturn, zend_object *object, zval *params, uint32_t param_count, zval *return_value);
 
 void uopz_return_free(zval *zv);
 
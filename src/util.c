@@ -25,6 +25,10 @@
 #include "class.h"
 #include "hook.h"
 #include "return.h"
+#include "function.h"
+#include "internal.h"
+#include "journal.h"
+#include "executors.h"
 #include "util.h"
 
 #include <Zend/zend_closures.h>
@@ -109,22 +113,52 @@ int uopz_find_method(zend_class_entry *ce, zend_string *name, zend_function **fu
 } /* }}} */
 
 int uopz_find_function(HashTable *table, zend_string *name, zend_function **function) { /* {{{ */
-	zend_string *key = zend_string_tolower(name);
-	zend_function *ptr = zend_hash_find_ptr(table, key);
-
-	/*zend_string_release(key);*/
+	zval *ptr = uopz_hash_find_lc(table, name);
 
 	if (!ptr) {
 		return FAILURE;
 	}
 
 	if (function) {
-		*function = ptr;
+		*function = Z_PTR_P(ptr);
 	}
 
 	return SUCCESS;
 } /* }}} */
 
+static zend_always_inline zend_bool uopz_is_lowercase(zend_string *name) { /* {{{ */
+	const unsigned char *it = (const unsigned char*) ZSTR_VAL(name);
+	const unsigned char *end = it + ZSTR_LEN(name);
+
+	while (it < end) {
+		if (*it != zend_tolower_ascii(*it)) {
+			return 0;
+		}
+		it++;
+	}
+
+	return 1;
+} /* }}} */
+
+zval* uopz_hash_find_lc(HashTable *table, zend_string *name) { /* {{{ */
+	zend_string *key;
+	zval *found;
+	ALLOCA_FLAG(use_heap);
+
+	if (uopz_is_lowercase(name)) {
+		return zend_hash_find(table, name);
+	}
+
+	ZSTR_ALLOCA_ALLOC(key, ZSTR_LEN(name), use_heap);
+	zend_str_tolower_copy(ZSTR_VAL(key), ZSTR_VAL(name), ZSTR_LEN(name));
+
+	found = zend_hash_find(table, key);
+
+	ZSTR_ALLOCA_FREE(key, use_heap);
+
+	return found;
+} /* }}} */
+
 zend_bool uopz_is_magic_method(zend_class_entry *clazz, zend_string *function) /* {{{ */
 { 
 	if (!clazz) {
@@ -177,18 +211,9 @@ int uopz_clean_function(zval *zv) { /* {{{ */
 	return ZEND_HASH_APPLY_KEEP;
 } /* }}} */
 
-int uopz_clean_class(zval *zv) { /* {{{ */
-	zend_class_entry *ce = Z_PTR_P(zv);
-
-#if PHP_VERSION_ID >= 70400
-	if (ce->ce_flags & ZEND_ACC_IMMUTABLE) {
-		return ZEND_HASH_APPLY_KEEP;
-	}
-#endif
-	zend_hash_apply(
-		&ce->function_table, uopz_clean_function);
-	
-	return ZEND_HASH_APPLY_KEEP;
+/* {{{ function tables uopz inserted into are the only ones cleaned at shutdown */
+void uopz_dirty(HashTable *table) {
+	zend_hash_index_add_ptr(&UOPZ(dirty), (zend_ulong) table, table);
 } /* }}} */
 
 static inline void uopz_caller_switch(zif_handler *old, zif_handler *new) {
@@ -218,32 +243,34 @@ static void uopz_callers_shutdown(void) { /* {{{ */
 	uopz_caller_switch(&uopz_call_user_func_array_ptr->handler, &zend_call_user_func_array_ptr->handler);
 } /* }}} */
 
-#define UOPZ_CALL_HOOKS(variadic) \
-	{ \
+#define UOPZ_CALL_HOOKS() \
+	/* internal functions are intercepted by their own trampoline */ \
+	if (UOPZ(intercepts) && !uopz_internal_trampolined(fcc.function_handler)) { \
 		uopz_hook_t *uhook = uopz_find_hook(fcc.function_handler); \
 		\
 		if (uhook && !uhook->busy) { \
-			uopz_execute_hook(uhook, execute_data, 1, variadic); \
+			uopz_execute_hook(uhook, fcc.object, fci.params, fci.param_count); \
 		} \
-	} \
-	\
-	do { \
-		uopz_return_t *ureturn = uopz_find_return(fcc.function_handler); \
 		\
-		if (ureturn) { \
-			if (UOPZ_RETURN_IS_EXECUTABLE(ureturn)) { \
-				if (UOPZ_RETURN_IS_BUSY(ureturn)) { \
-					break; \
+		do { \
+			uopz_return_t *ureturn = uopz_find_return(fcc.function_handler); \
+			\
+			if (ureturn) { \
+				if (UOPZ_RETURN_IS_EXECUTABLE(ureturn)) { \
+					if (UOPZ_RETURN_IS_BUSY(ureturn)) { \
+						break; \
+					} \
+					\
+					uopz_execute_return(ureturn, execute_data, return_value); \
+					return; \
 				} \
 				\
-				uopz_execute_return(ureturn, execute_data, return_value); \
+				UOPZ_STAT(calls); \
+				ZVAL_COPY(return_value, &ureturn->value); \
 				return; \
 			} \
-			\
-			ZVAL_COPY(return_value, &ureturn->value); \
-			return; \
-		} \
-	} while (0)
+		} while (0); \
+	}
 
 /* {{{ proto mixed uopz_call_user_func(callable function, ... args) */
 PHP_FUNCTION(uopz_call_user_func) {
@@ -258,7 +285,7 @@ PHP_FUNCTION(uopz_call_user_func) {
 
 	fci.retval = &retval;
 
-	UOPZ_CALL_HOOKS(0);
+	UOPZ_CALL_HOOKS();
 
 	if (zend_call_function(&fci, &fcc) == SUCCESS && Z_TYPE(retval) != IS_UNDEF) {
 		if (Z_ISREF(retval)) {
@@ -282,7 +309,7 @@ PHP_FUNCTION(uopz_call_user_func_array) {
 	zend_fcall_info_args(&fci, params);
 	fci.retval = &retval;
 
-	UOPZ_CALL_HOOKS(1);
+	UOPZ_CALL_HOOKS();
 
 	if (zend_call_function(&fci, &fcc) == SUCCESS && Z_TYPE(retval) != IS_UNDEF) {
 		if (Z_ISREF(retval)) {
@@ -294,21 +321,152 @@ PHP_FUNCTION(uopz_call_user_func_array) {
 	zend_fcall_info_args_clear(&fci, 1);
 } /* }}} */
 
+/* {{{ true while any frame is executing the opcodes of function */
+zend_bool uopz_function_active(zend_function *function) {
+	zend_execute_data *execute_data = EG(current_execute_data);
+
+	while (execute_data) {
+		if (EX(func) && 
+			EX(func)->type == ZEND_USER_FUNCTION &&
+			EX(func)->op_array.opcodes == function->op_array.opcodes) {
+			return 1;
+		}
+		execute_data = EX(prev_execute_data);
+	}
+
+	return 0;
+} /* }}} */
+
+static zend_always_inline zend_bool uopz_class_extends(zend_class_entry *ce, zend_class_entry *scope) { /* {{{ */
+#ifdef ZEND_ACC_LINKED
+	if (!(ce->ce_flags & ZEND_ACC_LINKED)) {
+		return 0;
+	}
+#endif
+
+	do {
+		if (ce == scope) {
+			return 1;
+		}
+	} while ((ce = ce->parent));
+
+	return 0;
+} /* }}} */
+
+/* {{{ visits function and every method inherited from it, found through the subclasses of its scope */
+void uopz_function_copies(zend_function *function, uopz_copy_visitor_t visitor, void *arg) {
+	zend_class_entry *scope = function->common.scope, *ce;
+	zend_function *copy;
+	zend_string *key;
+
+	if (!scope) {
+		visitor(function, arg);
+		return;
+	}
+
+	key = zend_string_tolower(function->common.function_name);
+
+	ZEND_HASH_FOREACH_PTR(CG(class_table), ce) {
+		if (ce->type != ZEND_USER_CLASS) {
+			continue;
+		}
+
+		/* trait methods are copied into the classes using the trait */
+		if (!(scope->ce_flags & ZEND_ACC_TRAIT) && !uopz_class_extends(ce, scope)) {
+			continue;
+		}
+
+		if ((copy = zend_hash_find_ptr(&ce->function_table, key))) {
+			visitor(copy, arg);
+		}
+	} ZEND_HASH_FOREACH_END();
+
+	zend_string_release(key);
+} /* }}} */
+
+void uopz_generation_bump(void) { /* {{{ */
+	uopz_return_cache_flush();
+	uopz_hook_cache_flush();
+
+	/* a batch moves every call site on once, when it ends */
+	if (UOPZ(batch)) {
+		UOPZ(batched) = 1;
+		return;
+	}
+
+	UOPZ(generation)++;
+} /* }}} */
+
+/* {{{ a function or mock was freed or swapped, the call sites caching it move on even within a batch */
+void uopz_generation_release(void) {
+	uopz_return_cache_flush();
+	uopz_hook_cache_flush();
+
+	UOPZ(batched) = 0;
+	UOPZ(generation)++;
+} /* }}} */
+
+void uopz_batch_begin(void) { /* {{{ */
+	UOPZ(batch)++;
+} /* }}} */
+
+void uopz_batch_end(void) { /* {{{ */
+	if (--UOPZ(batch) || !UOPZ(batched)) {
+		return;
+	}
+
+	UOPZ(batched) = 0;
+
+	uopz_generation_bump();
+} /* }}} */
+
 void uopz_request_init(void) { /* {{{ */
 	UOPZ(copts) = CG(compiler_options);
 
-	CG(compiler_options) |= ZEND_COMPILE_NO_CONSTANT_SUBSTITUTION | 
+	if (UOPZ(feature_constants)) {
+		CG(compiler_options) |= ZEND_COMPILE_NO_CONSTANT_SUBSTITUTION
 #ifdef ZEND_COMPILE_NO_PERSISTENT_CONSTANT_SUBSTITUTION
-				ZEND_COMPILE_NO_PERSISTENT_CONSTANT_SUBSTITUTION |
+					| ZEND_COMPILE_NO_PERSISTENT_CONSTANT_SUBSTITUTION
 #endif
-				ZEND_COMPILE_IGNORE_INTERNAL_FUNCTIONS | 
-				ZEND_COMPILE_IGNORE_USER_FUNCTIONS | 
-				ZEND_COMPILE_GUARDS;
+					;
+	}
+
+	if (UOPZ(feature_functions)) {
+		/* unresolved internal calls cannot be folded or typed from their signature by opcache */
+		CG(compiler_options) |= ZEND_COMPILE_NO_BUILTINS | 
+					ZEND_COMPILE_IGNORE_INTERNAL_FUNCTIONS |
+					ZEND_COMPILE_IGNORE_USER_FUNCTIONS | 
+					ZEND_COMPILE_GUARDS;
+	}
 
 	zend_hash_init(&UOPZ(functions), 8, NULL, uopz_table_dtor, 0);
+	zend_hash_init(&UOPZ(dirty), 8, NULL, NULL, 0);
+	zend_hash_init(&UOPZ(journal), 8, NULL, uopz_journal_free, 0);
+	UOPZ(journaled) = 0;
+	zend_hash_init(&UOPZ(snapshots), 8, NULL, NULL, 0);
+	UOPZ(snapshotted) = 0;
 	zend_hash_init(&UOPZ(returns), 8, NULL, uopz_table_dtor, 0);
-	zend_hash_init(&UOPZ(mocks), 8, NULL, uopz_zval_dtor, 0);
+	zend_hash_init(&UOPZ(mocks), 8, NULL, uopz_mock_free, 0);
+	zend_hash_init(&UOPZ(mcache), 8, NULL, NULL, 0);
+	UOPZ(statics) = 0;
 	zend_hash_init(&UOPZ(hooks), 8, NULL, uopz_table_dtor, 0);
+	zend_hash_init(&UOPZ(replacements), 8, NULL, uopz_replacement_free, 0);
+	zend_hash_init(&UOPZ(internals), 8, NULL, NULL, 0);
+
+	UOPZ(intercepts) = 0;
+	UOPZ(patches) = 0;
+	zend_hash_init(&UOPZ(rcache), 8, NULL, NULL, 0);
+	zend_hash_init(&UOPZ(hcache), 8, NULL, NULL, 0);
+	zend_hash_init(&UOPZ(sites), 8, NULL, uopz_site_free, 0);
+
+	UOPZ(generation) = 0;
+	UOPZ(batch) = 0;
+	UOPZ(batched) = 0;
+
+	memset(&UOPZ(stats), 0, sizeof(uopz_stats_t));
+	zend_hash_init(&UOPZ(stamps), 8, NULL, NULL, 0);
+
+	zend_hash_init(&UOPZ(constants), 8, NULL, NULL, 0);
 
 	{
 		char *report = getenv("UOPZ_REPORT_MEMLEAKS");
@@ -317,21 +475,78 @@ void uopz_request_init(void) { /* {{{ */
 			(report && report[0] == '1');
 	}
 
-	uopz_callers_init();
+	UOPZ(active) = 0;
+} /* }}} */
+
+/* {{{ the work only a request that uses uopz needs, with uopz.lazy the first call to the API does this */
+void uopz_request_activate(void) {
+	zend_class_entry *ce = NULL;
+	zend_string *spl;
+
+	if (UOPZ(active)) {
+		return;
+	}
+
+	UOPZ(active) = 1;
+
+	spl = zend_string_init(ZEND_STRL("RuntimeException"), 0);
+	spl_ce_RuntimeException =
+			(ce = zend_lookup_class(spl)) ?
+				ce : zend_exception_get_default();
+	zend_string_release(spl);
+
+	spl = zend_string_init(ZEND_STRL("InvalidArgumentException"), 0);
+	spl_ce_InvalidArgumentException =
+			(ce = zend_lookup_class(spl)) ?
+				ce : zend_exception_get_default();
+	zend_string_release(spl);
+
+	if (!UOPZ(observer)) {
+		uopz_callers_init();
+	}
 } /* }}} */
 
 void uopz_request_shutdown(void) { /* {{{ */
 	CG(compiler_options) = UOPZ(copts);
 
-	zend_hash_apply(CG(class_table),    uopz_clean_class);
-	zend_hash_apply(CG(function_table), uopz_clean_function);
+	zend_hash_destroy(&UOPZ(journal));
+	zend_hash_destroy(&UOPZ(snapshots));
+
+	/* patched, replaced and trampolined functions are restored before anything is destroyed */
+	uopz_internal_shutdown();
+	zend_hash_destroy(&UOPZ(replacements));
+	zend_hash_destroy(&UOPZ(returns));
+
+	{
+		HashTable *table;
+
+		ZEND_HASH_FOREACH_PTR(&UOPZ(dirty), table) {
+			zend_hash_apply(table, uopz_clean_function);
+		} ZEND_HASH_FOREACH_END();
+	}
 
 	zend_hash_destroy(&UOPZ(functions));
+	zend_hash_destroy(&UOPZ(dirty));
 	zend_hash_destroy(&UOPZ(mocks));
-	zend_hash_destroy(&UOPZ(returns));
+	zend_hash_destroy(&UOPZ(mcache));
 	zend_hash_destroy(&UOPZ(hooks));
 
-	uopz_callers_shutdown();
+	zend_hash_destroy(&UOPZ(rcache));
+	zend_hash_destroy(&UOPZ(hcache));
+	zend_hash_destroy(&UOPZ(sites));
+	UOPZ(intercepts) = 0;
+	uopz_executors_reset();
+
+	zend_hash_destroy(&UOPZ(stamps));
+	UOPZ(generation) = 0;
+
+	zend_hash_destroy(&UOPZ(constants));
+
+	if (UOPZ(active) && !UOPZ(observer)) {
+		uopz_callers_shutdown();
+	}
+
+	UOPZ(active) = 0;
 } /* }}} */
 
 #endif	/* UOPZ_UTIL */
@@ -19,25 +19,99 @@
 #ifndef UOPZ_UTIL_H
 #define UOPZ_UTIL_H
 
+#ifndef PHP_WIN32
+#	include <time.h>
+#endif
+
 extern PHP_FUNCTION(uopz_call_user_func);
 extern PHP_FUNCTION(uopz_call_user_func_array);
 
 void uopz_handle_magic(zend_class_entry *clazz, zend_string *name, zend_function *function);
 int uopz_find_function(HashTable *table, zend_string *name, zend_function **function);
+zval* uopz_hash_find_lc(HashTable *table, zend_string *name);
 int uopz_find_method(zend_class_entry *ce, zend_string *name, zend_function **function);
 
 zend_bool uopz_is_magic_method(zend_class_entry *clazz, zend_string *function);
 
 int uopz_clean_function(zval *zv);
-int uopz_clean_class(zval *zv);
+void uopz_dirty(HashTable *table);
+
+zend_bool uopz_function_active(zend_function *function);
+
+typedef void (*uopz_copy_visitor_t)(zend_function *copy, void *arg);
+void uopz_function_copies(zend_function *function, uopz_copy_visitor_t visitor, void *arg);
+
+void uopz_generation_bump(void);
+void uopz_generation_release(void);
+void uopz_batch_begin(void);
+void uopz_batch_end(void);
 
 void uopz_request_init(void);
+void uopz_request_activate(void);
 void uopz_request_shutdown(void);
 
+/* {{{ monotonic nanoseconds, 0 unless uopz.stats_time is set */
+static zend_always_inline zend_long uopz_stats_clock(void) {
+#ifdef PHP_WIN32
+	LARGE_INTEGER now, frequency;
+#else
+	struct timespec now;
+#endif
+
+	if (EXPECTED(!UOPZ(stats_time))) {
+		return 0;
+	}
+
+#ifdef PHP_WIN32
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&frequency);
+
+	return (zend_long) ((now.QuadPart / frequency.QuadPart) * 1000000000 +
+		(now.QuadPart % frequency.QuadPart) * 1000000000 / frequency.QuadPart);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (zend_long) now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+} /* }}} */
+
+static zend_always_inline void uopz_stats_elapsed(zend_long start) { /* {{{ */
+	if (start) {
+		UOPZ(stats).time += uopz_stats_clock() - start;
+	}
+} /* }}} */
+
 static inline void uopz_zval_dtor(zval *zv) { /* {{{ */
 	zval_ptr_dtor(zv);
 } /* }}} */
 
+/* {{{ arguments of an entered user frame, extra arguments were moved after the temporaries */
+static zend_always_inline zval* uopz_received_args(zend_execute_data *execute_data) {
+	uint32_t num_args = ZEND_CALL_NUM_ARGS(execute_data);
+	uint32_t first = EX(func)->op_array.num_args;
+	zval *params;
+
+	if (EXPECTED(num_args <= first)) {
+		return ZEND_CALL_ARG(execute_data, 1);
+	}
+
+	params = safe_emalloc(num_args, sizeof(zval), 0);
+
+	memcpy(params,
+		ZEND_CALL_ARG(execute_data, 1), sizeof(zval) * first);
+	memcpy(params + first,
+		ZEND_CALL_VAR_NUM(execute_data, EX(func)->op_array.last_var + EX(func)->op_array.T),
+		sizeof(zval) * (num_args - first));
+
+	return params;
+} /* }}} */
+
+static zend_always_inline void uopz_received_args_free(zend_execute_data *execute_data, zval *params) { /* {{{ */
+	if (params != ZEND_CALL_ARG(execute_data, 1)) {
+		efree(params);
+	}
+} /* }}} */
+
 static inline zend_bool uopz_is_cuf(zend_execute_data *execute_data) {
 	if (EX(func)->type == ZEND_INTERNAL_FUNCTION) {
 		if (EX(func)->internal_function.handler == zif_uopz_call_user_func) {
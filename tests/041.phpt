@@ -0,0 +1,50 @@
+--TEST--
+cached calls observe functions added and deleted later
+--SKIPIF--
+<?php include("skipif.inc") ?>
+--INI--
+uopz.disable=0
+--FILE--
+<?php
+namespace {
+	function qux() { return "global"; }
+
+	class Foo {}
+}
+
+namespace Test {
+	function call() {
+		return [qux(), method_exists(\Foo::class, "bar") ? \Foo::bar() : null];
+	}
+
+	var_dump(call());
+
+	uopz_add_function("Test\\qux", function() { return "namespaced"; });
+	uopz_add_function(\Foo::class, "bar", function() { return "bar"; }, ZEND_ACC_PUBLIC|ZEND_ACC_STATIC);
+
+	var_dump(call());
+
+	uopz_del_function("Test\\qux");
+
+	var_dump(call());
+}
+?>
+--EXPECT--
+array(2) {
+  [0]=>
+  string(6) "global"
+  [1]=>
+  NULL
+}
+array(2) {
+  [0]=>
+  string(10) "namespaced"
+  [1]=>
+  string(3) "bar"
+}
+array(2) {
+  [0]=>
+  string(6) "global"
+  [1]=>
+  string(3) "bar"
+}
@@ -0,0 +1,39 @@
+--TEST--
+redefined constants bypass the cache, untouched constants keep it
+--SKIPIF--
+<?php include("skipif.inc") ?>
+--INI--
+uopz.disable=0
+--FILE--
+<?php
+namespace Config {
+	const LIMIT = 1;
+}
+
+namespace {
+	const DEBUG = false;
+
+	class Foo {
+		const BAR = 1;
+	}
+
+	function read() {
+		return [\Config\LIMIT, DEBUG, Foo::BAR];
+	}
+
+	echo json_encode(read()), PHP_EOL;
+
+	uopz_redefine("Config\\LIMIT", 2);
+	uopz_redefine(Foo::class, "BAR", 2);
+
+	echo json_encode(read()), PHP_EOL;
+
+	uopz_redefine("DEBUG", true);
+
+	echo json_encode(read()), PHP_EOL;
+}
+?>
+--EXPECT--
+[1,false,1]
+[2,false,2]
+[2,true,2]
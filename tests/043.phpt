@@ -0,0 +1,34 @@
+--TEST--
+capabilities disabled by configuration throw
+--SKIPIF--
+<?php include("skipif.inc") ?>
+--INI--
+uopz.disable=0
+uopz.constants=0
+uopz.intercept_exit=0
+--FILE--
+<?php
+try {
+	uopz_redefine("FOO", 1);
+} catch (RuntimeException $ex) {
+	echo $ex->getMessage(), PHP_EOL;
+}
+
+try {
+	uopz_allow_exit(true);
+} catch (RuntimeException $ex) {
+	echo $ex->getMessage(), PHP_EOL;
+}
+
+var_dump(uopz_set_return("strlen", 42));
+var_dump(strlen("uopz"));
+
+exit("done\n");
+echo "not reached\n";
+?>
+--EXPECT--
+uopz_redefine is disabled by configuration (uopz.constants)
+uopz_allow_exit is disabled by configuration (uopz.intercept_exit)
+bool(true)
+int(42)
+done
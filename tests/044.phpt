@@ -0,0 +1,49 @@
+--TEST--
+executable return reuses its closure across calls and objects
+--SKIPIF--
+<?php include("skipif.inc") ?>
+--INI--
+uopz.disable=0
+--FILE--
+<?php
+class Foo {
+	private $name;
+
+	public function __construct($name) {
+		$this->name = $name;
+	}
+
+	public function name() {
+		return $this->name;
+	}
+
+	public static function make($name) {
+		return new static($name);
+	}
+}
+
+uopz_set_return(Foo::class, "name", function($suffix = "") {
+	return strtoupper($this->name) . $suffix;
+}, true);
+
+uopz_set_return(Foo::class, "make", function($name) {
+	return $name;
+}, true);
+
+$a = new Foo("a");
+$b = new Foo("b");
+
+for ($i = 0; $i < 2; $i++) {
+	var_dump($a->name(), $b->name("!"));
+}
+
+var_dump(Foo::make("static"));
+var_dump(call_user_func_array([Foo::class, "make"], ["cufa"]));
+?>
+--EXPECT--
+string(1) "A"
+string(2) "B!"
+string(1) "A"
+string(2) "B!"
+string(6) "static"
+string(4) "cufa"
@@ -0,0 +1,49 @@
+--TEST--
+hooks fire for direct calls and call_user_func
+--SKIPIF--
+<?php include("skipif.inc") ?>
+--INI--
+uopz.disable=0
+--FILE--
+<?php
+class Foo {
+	private $name = "foo";
+
+	public function bar($arg) {
+		return $arg;
+	}
+}
+
+function baz($a, $b) {
+	return $a + $b;
+}
+
+uopz_set_hook(Foo::class, "bar", function($arg) {
+	echo "hook ", $this->name, " ", $arg, PHP_EOL;
+});
+
+uopz_set_hook("baz", function($a, $b) {
+	echo "hook baz ", $a, " ", $b, PHP_EOL;
+});
+
+$foo = new Foo();
+
+var_dump($foo->bar(1));
+var_dump(call_user_func([$foo, "bar"], 2));
+var_dump(baz(1, 2));
+var_dump(call_user_func_array("baz", [3, 4]));
+
+uopz_unset_hook("baz");
+
+var_dump(baz(5, 6));
+?>
+--EXPECT--
+hook foo 1
+int(1)
+hook foo 2
+int(2)
+hook baz 1 2
+int(3)
+hook baz 3 4
+int(7)
+int(11)
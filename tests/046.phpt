@@ -0,0 +1,69 @@
+--TEST--
+observer backend runs hooks and refuses unsupported features
+--SKIPIF--
+<?php
+include("skipif.inc");
+if (PHP_VERSION_ID < 80000) die("skip requires PHP 8");
+if (function_exists('opcache_get_status')
+	&& ($status = opcache_get_status())
+	&& $status['opcache_enabled'])
+{
+	die('skip not with OPcache, immutable functions are not patched');
+}
+?>
+--INI--
+uopz.disable=0
+uopz.observer=1
+--FILE--
+<?php
+class Foo {
+	public function bar(...$args) {
+		return count($args);
+	}
+}
+
+function baz($a) {
+	return $a;
+}
+
+var_dump(baz(1));
+
+uopz_set_hook("baz", function($a) {
+	echo "hook baz ", $a, PHP_EOL;
+});
+
+uopz_set_hook(Foo::class, "bar", function(...$args) {
+	echo "hook bar ", implode(",", $args), PHP_EOL;
+});
+
+var_dump(baz(2));
+var_dump((new Foo)->bar(1, 2, 3));
+
+uopz_unset_hook("baz");
+
+var_dump(baz(3));
+
+var_dump(uopz_set_return("baz", 42));
+var_dump(baz(4));
+
+try {
+	uopz_set_return("baz", function($a) {
+		return $a * 2;
+	}, true);
+} catch (RuntimeException $ex) {
+	echo $ex->getMessage(), PHP_EOL;
+}
+
+var_dump(baz(5));
+?>
+--EXPECT--
+int(1)
+hook baz 2
+int(2)
+hook bar 1,2,3
+int(3)
+int(3)
+bool(true)
+int(42)
+failed to set return for baz, the observer backend only supports constant returns for user functions
+int(42)
@@ -0,0 +1,69 @@
+--TEST--
+constant returns patched into user functions are restored
+--SKIPIF--
+<?php
+include("skipif.inc");
+if (version_compare(PHP_VERSION, '7.4', '>=')
+	&& function_exists('opcache_get_status')
+	&& ($status = opcache_get_status())
+	&& $status['opcache_enabled'])
+{
+	die('skip not for PHP 7.4+ with OPcache');
+}
+?>
+--INI--
+uopz.disable=0
+--FILE--
+<?php
+class Foo {
+	public function bar($a, $b = 2) {
+		try {
+			return $a + $b;
+		} catch (Exception $ex) {
+			return -1;
+		}
+	}
+}
+
+class Child extends Foo {}
+
+function qux($a, ...$rest) {
+	return $a;
+}
+
+uopz_set_return(Foo::class, "bar", "patched");
+uopz_set_return("qux", [1, 2]);
+
+var_dump(uopz_stats()["patches"]);
+
+var_dump((new Foo)->bar(1), (new Child)->bar(1, 2, 3));
+var_dump(qux(1, 2, 3), call_user_func("qux", 4));
+
+uopz_unset_return(Foo::class, "bar");
+uopz_unset_return("qux");
+
+var_dump(uopz_stats()["patches"]);
+
+var_dump((new Foo)->bar(1), (new Child)->bar(1, 3));
+var_dump(qux(5));
+?>
+--EXPECT--
+int(2)
+string(7) "patched"
+string(7) "patched"
+array(2) {
+  [0]=>
+  int(1)
+  [1]=>
+  int(2)
+}
+array(2) {
+  [0]=>
+  int(1)
+  [1]=>
+  int(2)
+}
+int(0)
+int(3)
+int(4)
+int(5)
@@ -0,0 +1,44 @@
+--TEST--
+specialized call sites follow return changes
+--SKIPIF--
+<?php include("skipif.inc") ?>
+--INI--
+uopz.disable=0
+uopz.specialize=1
+--FILE--
+<?php
+class Foo {
+	public function bar() { return "bar"; }
+}
+
+class Qux extends Foo {
+	public function bar() { return "qux"; }
+}
+
+function call(Foo $foo) {
+	return $foo->bar();
+}
+
+uopz_set_return(Foo::class, "bar", function() { return "executed"; }, true);
+uopz_set_return(Qux::class, "bar", "constant");
+
+$foo = new Foo;
+$qux = new Qux;
+
+for ($i = 0; $i < 2; $i++) {
+	var_dump(call($foo), call($qux));
+}
+
+uopz_set_return(Qux::class, "bar", "changed");
+var_dump(call($qux));
+
+uopz_unset_return(Qux::class, "bar");
+var_dump(call($qux));
+?>
+--EXPECT--
+string(8) "executed"
+string(8) "constant"
+string(8) "executed"
+string(8) "constant"
+string(7) "changed"
+string(3) "qux"
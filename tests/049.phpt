@@ -0,0 +1,76 @@
+--TEST--
+uopz_replace_function/uopz_restore_function
+--SKIPIF--
+<?php
+include("skipif.inc");
+if (version_compare(PHP_VERSION, '7.4', '>=')
+	&& function_exists('opcache_get_status')
+	&& ($status = opcache_get_status())
+	&& $status['opcache_enabled'])
+{
+	die('skip not for PHP 7.4+ with OPcache');
+}
+?>
+--INI--
+uopz.disable=0
+--FILE--
+<?php
+class Foo {
+	protected $x = 2;
+
+	public function bar($a) {
+		return $a;
+	}
+}
+
+class Child extends Foo {}
+
+function qux($a) {
+	return $a;
+}
+
+function recurse() {
+	uopz_replace_function("recurse", function() {});
+}
+
+var_dump(uopz_replace_function(Foo::class, "bar", function($a) {
+	return $this->x * $a;
+}));
+var_dump(uopz_replace_function("qux", function($a, $b = 10) {
+	return $a + $b;
+}));
+
+var_dump((new Foo)->bar(3), (new Child)->bar(4));
+var_dump(qux(1), call_user_func("qux", 1, 2));
+
+var_dump(uopz_restore_function(Foo::class, "bar"));
+var_dump(uopz_restore_function("qux"));
+
+var_dump((new Foo)->bar(3), (new Child)->bar(4), qux(1));
+
+try {
+	uopz_restore_function("qux");
+} catch (RuntimeException $ex) {
+	echo $ex->getMessage(), PHP_EOL;
+}
+
+try {
+	recurse();
+} catch (RuntimeException $ex) {
+	echo $ex->getMessage(), PHP_EOL;
+}
+?>
+--EXPECT--
+bool(true)
+bool(true)
+int(6)
+int(8)
+int(11)
+int(3)
+bool(true)
+bool(true)
+int(3)
+int(4)
+int(1)
+failed to restore function qux, it was not replaced
+failed to replace function recurse, it is executing
@@ -0,0 +1,57 @@
+--TEST--
+internal functions are intercepted through their handler
+--SKIPIF--
+<?php include("skipif.inc") ?>
+--INI--
+uopz.disable=0
+opcache.enable=1
+opcache.enable_cli=1
+opcache.optimization_level=-1
+--FILE--
+<?php
+class Bag extends ArrayObject {}
+
+uopz_set_return("strlen", 42);
+uopz_set_hook("str_repeat", function($string, $times) {
+	echo "str_repeat({$string}, {$times})\n";
+});
+uopz_set_return(ArrayObject::class, "count", function() {
+	return -1;
+}, true);
+uopz_set_return("function_exists", "stubbed");
+
+$fn = "strlen";
+
+var_dump(strlen("abc"), $fn("abc"), call_user_func("strlen", "abc"));
+var_dump(str_repeat("a", 2));
+var_dump((new ArrayObject([1]))->count(), (new Bag([1, 2]))->count());
+var_dump(function_exists("strlen"), strlen("abc") + 1);
+
+uopz_unset_return("strlen");
+uopz_unset_hook("str_repeat");
+uopz_unset_return(ArrayObject::class, "count");
+uopz_unset_return("function_exists");
+
+var_dump(strlen("abc"), $fn("abc"), call_user_func("strlen", "abc"));
+var_dump(str_repeat("a", 2));
+var_dump((new ArrayObject([1]))->count(), (new Bag([1, 2]))->count());
+var_dump(function_exists("strlen"), strlen("abc") + 1);
+?>
+--EXPECT--
+int(42)
+int(42)
+int(42)
+str_repeat(a, 2)
+string(2) "aa"
+int(-1)
+int(-1)
+string(7) "stubbed"
+int(43)
+int(3)
+int(3)
+int(3)
+string(2) "aa"
+int(1)
+int(2)
+bool(true)
+int(4)
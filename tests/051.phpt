@@ -0,0 +1,88 @@
+--TEST--
+callbacks invoked by internal functions are intercepted
+--SKIPIF--
+<?php include("skipif.inc") ?>
+--INI--
+uopz.disable=0
+--FILE--
+<?php
+function double($x) {
+	return $x * 2;
+}
+
+function &ref() {
+	static $v = 0;
+	return $v;
+}
+
+class Cmp {
+	public static function cmp($a, $b) {
+		return $a <=> $b;
+	}
+}
+
+uopz_set_hook("double", function($x) {
+	echo "double({$x})\n";
+});
+uopz_set_return("ref", 5);
+uopz_set_return(Cmp::class, "cmp", function($a, $b) {
+	return $b <=> $a;
+}, true);
+
+var_dump(array_map("double", [1, 2]));
+var_dump(double(3));
+var_dump(array_map("ref", [1]));
+
+$a = [1, 3, 2];
+usort($a, [Cmp::class, "cmp"]);
+var_dump($a);
+
+uopz_unset_hook("double");
+uopz_unset_return("ref");
+uopz_unset_return(Cmp::class, "cmp");
+
+var_dump(array_map("double", [1]));
+var_dump(array_map("ref", [1]));
+
+usort($a, [Cmp::class, "cmp"]);
+var_dump($a);
+?>
+--EXPECT--
+double(1)
+double(2)
+array(2) {
+  [0]=>
+  int(2)
+  [1]=>
+  int(4)
+}
+double(3)
+int(6)
+array(1) {
+  [0]=>
+  int(5)
+}
+array(3) {
+  [0]=>
+  int(3)
+  [1]=>
+  int(2)
+  [2]=>
+  int(1)
+}
+array(1) {
+  [0]=>
+  int(2)
+}
+array(1) {
+  [0]=>
+  int(0)
+}
+array(3) {
+  [0]=>
+  int(1)
+  [1]=>
+  int(2)
+  [2]=>
+  int(3)
+}
@@ -0,0 +1,56 @@
+--TEST--
+mocks are resolved by class entry and follow changes
+--SKIPIF--
+<?php include("skipif.inc") ?>
+--INI--
+uopz.disable=0
+--FILE--
+<?php
+class Foo {
+	public static function create() {
+		return new static;
+	}
+}
+
+class Bar extends Foo {}
+class Qux {}
+
+function make($class) {
+	return new $class;
+}
+
+var_dump(get_class(make(Foo::class)), get_class(Foo::create()));
+
+uopz_set_mock(Foo::class, Bar::class);
+
+var_dump(get_class(new Foo), get_class(make(Foo::class)), get_class(Foo::create()));
+
+uopz_set_mock(Foo::class, Qux::class);
+
+var_dump(get_class(new Foo), get_class(make(Foo::class)), get_class(Foo::create()));
+
+uopz_set_mock(Foo::class, "Missing");
+
+try {
+	new Foo;
+} catch (Error $e) {
+	echo get_class($e), PHP_EOL;
+}
+
+uopz_unset_mock(Foo::class);
+
+var_dump(get_class(new Foo), get_class(make(Foo::class)), get_class(Foo::create()));
+?>
+--EXPECT--
+string(3) "Foo"
+string(3) "Foo"
+string(3) "Bar"
+string(3) "Bar"
+string(3) "Bar"
+string(3) "Qux"
+string(3) "Qux"
+string(3) "Qux"
+Error
+string(3) "Foo"
+string(3) "Foo"
+string(3) "Foo"
@@ -0,0 +1,57 @@
+--TEST--
+instantiations without a mock are left to the engine
+--SKIPIF--
+<?php include("skipif.inc") ?>
+--INI--
+uopz.disable=0
+--FILE--
+<?php
+class Foo {
+	public $args;
+
+	public function __construct(...$args) {
+		$this->args = $args;
+	}
+
+	public static function create() {
+		return new self(1);
+	}
+}
+
+class Bar {}
+class Qux extends Foo {}
+
+uopz_set_mock(Bar::class, Qux::class);
+
+$class = Foo::class;
+
+var_dump((new Foo(1, 2))->args, (new $class(3))->args, Foo::create()->args);
+var_dump(get_class(new Bar(4)), (new Bar(5))->args);
+
+try {
+	new Missing;
+} catch (Error $e) {
+	echo get_class($e), PHP_EOL;
+}
+?>
+--EXPECT--
+array(2) {
+  [0]=>
+  int(1)
+  [1]=>
+  int(2)
+}
+array(1) {
+  [0]=>
+  int(3)
+}
+array(1) {
+  [0]=>
+  int(1)
+}
+string(3) "Qux"
+array(1) {
+  [0]=>
+  int(5)
+}
+Error
@@ -0,0 +1,65 @@
+--TEST--
+uopz_set_mock with statics
+--SKIPIF--
+<?php include("skipif.inc") ?>
+--INI--
+uopz.disable=0
+--FILE--
+<?php
+class Foo {
+	const BAR = "Foo";
+
+	public static function create() {
+		return "Foo::create";
+	}
+}
+
+class Mock {
+	const BAR = "Mock";
+
+	public static function create() {
+		return "Mock::create";
+	}
+}
+
+function test() {
+	return [Foo::create(), Foo::BAR, new Foo];
+}
+
+uopz_set_mock(Foo::class, Mock::class);
+var_dump(test());
+
+uopz_set_mock(Foo::class, Mock::class, true);
+var_dump(test());
+
+uopz_unset_mock(Foo::class);
+var_dump(test());
+?>
+--EXPECTF--
+array(3) {
+  [0]=>
+  string(11) "Foo::create"
+  [1]=>
+  string(3) "Foo"
+  [2]=>
+  object(Mock)#%d (0) {
+  }
+}
+array(3) {
+  [0]=>
+  string(12) "Mock::create"
+  [1]=>
+  string(4) "Mock"
+  [2]=>
+  object(Mock)#%d (0) {
+  }
+}
+array(3) {
+  [0]=>
+  string(11) "Foo::create"
+  [1]=>
+  string(3) "Foo"
+  [2]=>
+  object(Foo)#%d (0) {
+  }
+}
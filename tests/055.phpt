@@ -0,0 +1,52 @@
+--TEST--
+dynamic calls across function mutation
+--SKIPIF--
+<?php include("skipif.inc") ?>
+--INI--
+uopz.disable=0
+--FILE--
+<?php
+class Foo {}
+
+function test($foo) {
+	$fn = "bar";
+	$result = [];
+
+	foreach ([$fn, [$foo, "bar"], "Foo::qux", [Foo::class, "qux"]] as $call) {
+		try {
+			$result[] = $call();
+		} catch (Error $e) {
+			$result[] = get_class($e);
+		}
+	}
+
+	try {
+		$result[] = call_user_func($fn);
+	} catch (Error $e) {
+		$result[] = get_class($e);
+	}
+
+	return implode(",", $result);
+}
+
+$foo = new Foo;
+
+uopz_add_function("bar", function() { return "bar"; });
+uopz_add_function(Foo::class, "bar", function() { return "Foo::bar"; });
+uopz_add_function(Foo::class, "qux", function() { return "Foo::qux"; }, ZEND_ACC_STATIC);
+var_dump(test($foo));
+
+uopz_del_function("bar");
+uopz_del_function(Foo::class, "bar");
+uopz_del_function(Foo::class, "qux");
+var_dump(@test($foo));
+
+uopz_add_function("bar", function() { return "new bar"; });
+uopz_add_function(Foo::class, "bar", function() { return "new Foo::bar"; });
+uopz_add_function(Foo::class, "qux", function() { return "new Foo::qux"; }, ZEND_ACC_STATIC);
+var_dump(test($foo));
+?>
+--EXPECTF--
+string(%d) "bar,Foo::bar,Foo::qux,Foo::qux,bar"
+string(%d) "Error,Error,Error,Error,%A"
+string(%d) "new bar,new Foo::bar,new Foo::qux,new Foo::qux,new bar"
@@ -0,0 +1,33 @@
+--TEST--
+uopz.lazy activates on the first call
+--SKIPIF--
+<?php include("skipif.inc") ?>
+--INI--
+uopz.disable=0
+uopz.lazy=1
+--FILE--
+<?php
+class Foo {
+	public static function bar() {
+		return "bar";
+	}
+}
+
+var_dump(call_user_func([Foo::class, "bar"]));
+
+uopz_set_return(Foo::class, "bar", "lazy");
+
+var_dump(Foo::bar());
+var_dump(call_user_func([Foo::class, "bar"]));
+
+try {
+	uopz_unset_mock("Missing");
+} catch (RuntimeException $e) {
+	var_dump($e->getMessage());
+}
+?>
+--EXPECT--
+string(3) "bar"
+string(4) "lazy"
+string(4) "lazy"
+string(44) "the class provided (Missing) has no mock set"
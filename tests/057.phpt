@@ -0,0 +1,92 @@
+--TEST--
+uopz_snapshot and uopz_restore
+--SKIPIF--
+<?php include("skipif.inc") ?>
+--INI--
+uopz.disable=0
+--FILE--
+<?php
+const LIMIT = 10;
+
+class Foo {
+	public static $count = 1;
+
+	public function bar() {
+		return "bar";
+	}
+
+	public function qux() {
+		return "qux";
+	}
+}
+
+class Mock extends Foo {}
+
+function state() {
+	$foo = new Foo;
+
+	return [
+		get_class($foo),
+		$foo->bar(),
+		$foo->qux(),
+		defined("LIMIT") ? LIMIT : null,
+		Foo::$count,
+		method_exists(Foo::class, "added"),
+	];
+}
+
+$first = uopz_snapshot();
+
+uopz_set_return(Foo::class, "bar", "before");
+
+$snapshot = uopz_snapshot();
+
+uopz_set_return(Foo::class, "bar", "after");
+uopz_set_return(Foo::class, "qux", "after");
+uopz_set_mock(Foo::class, Mock::class);
+uopz_redefine("LIMIT", 20);
+uopz_set_property(Foo::class, "count", 2);
+uopz_add_function(Foo::class, "added", function() {});
+
+echo json_encode(state()), PHP_EOL;
+
+var_dump(uopz_restore($snapshot));
+
+echo json_encode(state()), PHP_EOL;
+
+try {
+	uopz_restore($snapshot);
+} catch (InvalidArgumentException $e) {
+	echo get_class($e), PHP_EOL;
+}
+
+var_dump(uopz_restore($first));
+
+echo json_encode(state()), PHP_EOL;
+
+/* a restored snapshot stays restored once later snapshots are taken */
+$next = uopz_snapshot();
+
+uopz_set_return(Foo::class, "bar", "next");
+
+try {
+	uopz_restore($first);
+} catch (InvalidArgumentException $e) {
+	echo get_class($e), PHP_EOL;
+}
+
+var_dump($next !== $first, uopz_restore($next));
+
+echo json_encode(state()), PHP_EOL;
+?>
+--EXPECT--
+["Mock","after","after",20,2,true]
+bool(true)
+["Foo","before","qux",10,1,false]
+InvalidArgumentException
+bool(true)
+["Foo","bar","qux",10,1,false]
+InvalidArgumentException
+bool(true)
+bool(true)
+["Foo","bar","qux",10,1,false]
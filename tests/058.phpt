@@ -0,0 +1,52 @@
+--TEST--
+uopz_apply
+--SKIPIF--
+<?php include("skipif.inc") ?>
+--INI--
+uopz.disable=0
+--FILE--
+<?php
+const LIMIT = 10;
+
+class Foo {
+	public function bar() {
+		return "bar";
+	}
+}
+
+function state() {
+	return [(new Foo)->bar(), LIMIT, function_exists("added") ? added() : null];
+}
+
+var_dump(uopz_apply([
+	["set_return", Foo::class, "bar", "applied"],
+	["redefine", "LIMIT", 20],
+	["add_function", "added", function() { return "added"; }],
+]));
+
+echo json_encode(state()), PHP_EOL;
+
+try {
+	uopz_apply([
+		["set_return", Foo::class, "bar", "failed"],
+		["redefine", "LIMIT", 30],
+		["del_function", "missing"],
+	]);
+} catch (RuntimeException $e) {
+	echo $e->getMessage(), PHP_EOL;
+}
+
+echo json_encode(state()), PHP_EOL;
+
+try {
+	uopz_apply([["extend", Foo::class, stdClass::class]]);
+} catch (InvalidArgumentException $e) {
+	echo $e->getMessage(), PHP_EOL;
+}
+?>
+--EXPECT--
+bool(true)
+["applied",20,"added"]
+cannot delete function missing, it was not added by uopz
+["applied",20,"added"]
+operation 0 is not supported, expected [name, ...arguments]
@@ -0,0 +1,59 @@
+--TEST--
+uopz_stats
+--SKIPIF--
+<?php include("skipif.inc") ?>
+--INI--
+uopz.disable=0
+uopz.stats_time=1
+--FILE--
+<?php
+class Foo {
+	public function bar() {
+		return "bar";
+	}
+}
+
+class Mock extends Foo {}
+
+uopz_set_return(Foo::class, "bar", function() {
+	return "mocked";
+}, true);
+uopz_set_mock(Foo::class, Mock::class);
+
+$foo = new Foo;
+
+for ($i = 0; $i < 3; $i++) {
+	$foo->bar();
+}
+
+$stats = uopz_stats();
+
+var_dump(array_keys($stats));
+var_dump($stats["calls"], $stats["closures"], $stats["mocks"]);
+var_dump($stats["hits"] >= 3, $stats["lookups"] >= $stats["hits"], $stats["time"] >= 0);
+?>
+--EXPECT--
+array(8) {
+  [0]=>
+  string(7) "lookups"
+  [1]=>
+  string(4) "hits"
+  [2]=>
+  string(5) "calls"
+  [3]=>
+  string(8) "closures"
+  [4]=>
+  string(5) "mocks"
+  [5]=>
+  string(5) "slots"
+  [6]=>
+  string(7) "patches"
+  [7]=>
+  string(4) "time"
+}
+int(3)
+int(1)
+int(1)
+bool(true)
+bool(true)
+bool(true)
@@ -0,0 +1,58 @@
+--TEST--
+uopz_replace_function copies inherited after the replacement
+--SKIPIF--
+<?php
+include("skipif.inc");
+if (version_compare(PHP_VERSION, '7.4', '>=')
+	&& function_exists('opcache_get_status')
+	&& ($status = opcache_get_status())
+	&& $status['opcache_enabled'])
+{
+	die('skip not for PHP 7.4+ with OPcache');
+}
+?>
+--INI--
+uopz.disable=0
+--FILE--
+<?php
+class Foo {
+	public function bar($a) {
+		return $a;
+	}
+}
+
+var_dump(uopz_replace_function(Foo::class, "bar", function($a) {
+	return $a * 2;
+}));
+
+eval('class Later extends Foo {}');
+
+var_dump((new Later)->bar(3));
+var_dump(uopz_restore_function(Foo::class, "bar"));
+var_dump((new Foo)->bar(3), (new Later)->bar(3));
+
+eval('class Child extends Foo {}');
+
+var_dump(uopz_add_function(Foo::class, "qux", function() {
+	return 1;
+}, ZEND_ACC_PUBLIC, true));
+
+var_dump(uopz_replace_function(Foo::class, "qux", function() {
+	return 2;
+}));
+var_dump((new Foo)->qux(), (new Child)->qux());
+var_dump(uopz_del_function(Foo::class, "qux", true));
+var_dump(method_exists(Child::class, "qux"));
+?>
+--EXPECT--
+bool(true)
+int(6)
+bool(true)
+int(3)
+int(3)
+bool(true)
+bool(true)
+int(2)
+int(1)
+bool(true)
+bool(false)
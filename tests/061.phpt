@@ -0,0 +1,36 @@
+--TEST--
+internal methods inherited after a return or hook was set
+--SKIPIF--
+<?php include("skipif.inc") ?>
+--INI--
+uopz.disable=0
+--FILE--
+<?php
+var_dump(uopz_set_return(ArrayObject::class, "count", 5));
+var_dump(uopz_set_hook(ArrayObject::class, "getArrayCopy", function() {
+	echo "hook\n";
+}));
+
+eval('class Later extends ArrayObject {}');
+
+$later = new Later([1, 2]);
+
+var_dump($later->count());
+var_dump(count($later->getArrayCopy()));
+
+var_dump(uopz_unset_return(ArrayObject::class, "count"));
+var_dump(uopz_unset_hook(ArrayObject::class, "getArrayCopy"));
+
+var_dump($later->count());
+var_dump(count($later->getArrayCopy()));
+?>
+--EXPECT--
+bool(true)
+bool(true)
+int(5)
+hook
+int(2)
+bool(true)
+bool(true)
+int(2)
+int(2)
@@ -0,0 +1,45 @@
+--TEST--
+generators resumed by internal code are not intercepted
+--SKIPIF--
+<?php include("skipif.inc") ?>
+--INI--
+uopz.disable=0
+--FILE--
+<?php
+function gen() {
+	$local = "kept";
+	yield 1;
+	yield $local;
+}
+
+function other() {
+	return 1;
+}
+
+var_dump(uopz_set_return("other", function() {
+	return 2;
+}, true));
+
+$gen = gen();
+
+foreach (new IteratorIterator($gen) as $value) {
+	var_dump($value);
+}
+
+var_dump(iterator_to_array(gen(), false));
+var_dump(array_map("other", [1]));
+?>
+--EXPECT--
+bool(true)
+int(1)
+string(4) "kept"
+array(2) {
+  [0]=>
+  int(1)
+  [1]=>
+  string(4) "kept"
+}
+array(1) {
+  [0]=>
+  int(2)
+}
@@ -0,0 +1,33 @@
+--TEST--
+uopz_stats counts constant returns
+--SKIPIF--
+<?php include("skipif.inc") ?>
+--INI--
+uopz.disable=0
+--FILE--
+<?php
+function patched() {
+	return "original";
+}
+
+class Foo {
+	public function bar() {
+		return "original";
+	}
+}
+
+uopz_set_return("patched", "patched");
+uopz_set_return(Foo::class, "bar", "intercepted");
+uopz_set_return("strlen", 42);
+
+$foo = new Foo;
+
+var_dump(patched(), $foo->bar(), strlen("four"));
+
+var_dump(uopz_stats()["calls"]);
+?>
+--EXPECT--
+string(7) "patched"
+string(11) "intercepted"
+int(42)
+int(3)
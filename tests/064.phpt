@@ -0,0 +1,82 @@
+--TEST--
+uopz_apply loads only the classes operations name and checks arguments up front
+--SKIPIF--
+<?php include("skipif.inc") ?>
+--INI--
+uopz.disable=0
+--FILE--
+<?php
+spl_autoload_register(function($class) {
+	throw new Exception("autoload {$class}");
+});
+
+class Foo {
+	public function bar() {
+		return "bar";
+	}
+}
+
+function qux() {
+	return "qux";
+}
+
+const LIMIT = 10;
+
+var_dump(uopz_apply([
+	["set_return", Foo::class, "bar", "applied"],
+	["set_return", "strlen", 42],
+	["set_hook", "qux", function() {
+		echo "hook qux", PHP_EOL;
+	}],
+	["redefine", "LIMIT", 20],
+	["add_function", "added", function() {
+		return "added";
+	}],
+]));
+
+var_dump((new Foo)->bar(), strlen("abc"), qux(), LIMIT, added());
+
+try {
+	uopz_apply([
+		["redefine", "LIMIT", 30],
+		["set_hook", "qux"],
+	]);
+} catch (InvalidArgumentException $e) {
+	echo $e->getMessage(), PHP_EOL;
+}
+
+try {
+	uopz_apply([
+		["redefine", "LIMIT", 30],
+		["set_return", Foo::class, "bar", "ok", true, 1],
+	]);
+} catch (InvalidArgumentException $e) {
+	echo $e->getMessage(), PHP_EOL;
+}
+
+var_dump(LIMIT);
+
+try {
+	uopz_apply([
+		["redefine", "LIMIT", 30],
+		["set_return", "Missing", "bar", 1],
+	]);
+} catch (Exception $e) {
+	echo $e->getMessage(), PHP_EOL;
+}
+
+var_dump(LIMIT);
+?>
+--EXPECT--
+bool(true)
+hook qux
+string(7) "applied"
+int(42)
+string(3) "qux"
+int(20)
+string(5) "added"
+operation 1 (set_hook) has unexpected arguments
+operation 1 (set_return) has unexpected arguments
+int(20)
+autoload Missing
+int(20)
@@ -34,6 +34,8 @@
 #include "src/function.h"
 #include "src/handlers.h"
 #include "src/executors.h"
+#include "src/observer.h"
+#include "src/journal.h"
 
 ZEND_DECLARE_MODULE_GLOBALS(uopz)
 
@@ -46,11 +48,39 @@ ZEND_DECLARE_MODULE_GLOBALS(uopz)
 		zend_throw_exception_ex(spl_ce_RuntimeException, 0, "uopz is disabled by configuration (uopz.disable)"); \
 		return; \
 	} \
+	uopz_request_activate(); \
 } while(0)
 
+#define uopz_feature_guard(feature, ini) do { \
+	if (!UOPZ(feature)) { \
+		zend_throw_exception_ex(spl_ce_RuntimeException, 0, "%s is disabled by configuration (%s)", get_active_function_name(), ini); \
+		return; \
+	} \
+} while(0)
+
+#if PHP_VERSION_ID >= 80000
+#define uopz_observer_guard() do { \
+	if (UOPZ(observer)) { \
+		zend_throw_exception_ex(spl_ce_RuntimeException, 0, "%s is not supported by the observer backend (uopz.observer)", get_active_function_name()); \
+		return; \
+	} \
+} while(0)
+#else
+#define uopz_observer_guard()
+#endif
+
 PHP_INI_BEGIN()
 	STD_PHP_INI_ENTRY("uopz.disable", "0", PHP_INI_SYSTEM, OnUpdateBool, disable, zend_uopz_globals, uopz_globals)
 	STD_PHP_INI_ENTRY("uopz.exit",    "0", PHP_INI_SYSTEM, OnUpdateBool, exit,    zend_uopz_globals, uopz_globals)
+	STD_PHP_INI_ENTRY("uopz.constants",      "1", PHP_INI_SYSTEM, OnUpdateBool, feature_constants, zend_uopz_globals, uopz_globals)
+	STD_PHP_INI_ENTRY("uopz.functions",      "1", PHP_INI_SYSTEM, OnUpdateBool, feature_functions, zend_uopz_globals, uopz_globals)
+	STD_PHP_INI_ENTRY("uopz.intercept_exit", "1", PHP_INI_SYSTEM, OnUpdateBool, intercept_exit,    zend_uopz_globals, uopz_globals)
+	STD_PHP_INI_ENTRY("uopz.specialize",     "0", PHP_INI_SYSTEM, OnUpdateBool, specialize,        zend_uopz_globals, uopz_globals)
+	STD_PHP_INI_ENTRY("uopz.lazy",           "0", PHP_INI_SYSTEM, OnUpdateBool, lazy,              zend_uopz_globals, uopz_globals)
+	STD_PHP_INI_ENTRY("uopz.stats_time",     "0", PHP_INI_SYSTEM, OnUpdateBool, stats_time,        zend_uopz_globals, uopz_globals)
+#if PHP_VERSION_ID >= 80000
+	STD_PHP_INI_ENTRY("uopz.observer",       "0", PHP_INI_SYSTEM, OnUpdateBool, observer,          zend_uopz_globals, uopz_globals)
+#endif
 PHP_INI_END()
 
 /* {{{ */
@@ -78,7 +108,12 @@ static PHP_MINIT_FUNCTION(uopz)
 	REGISTER_LONG_CONSTANT("ZEND_ACC_FINAL", 				ZEND_ACC_FINAL,					CONST_CS|CONST_PERSISTENT);
 	REGISTER_LONG_CONSTANT("ZEND_ACC_ABSTRACT", 			ZEND_ACC_ABSTRACT,				CONST_CS|CONST_PERSISTENT);
 
-	uopz_executors_init();
+	if (UOPZ(observer)) {
+		uopz_observer_init();
+	} else {
+		uopz_executors_init();
+	}
+
 	uopz_handlers_init();
 
 	return SUCCESS;
@@ -93,7 +128,10 @@ static PHP_MSHUTDOWN_FUNCTION(uopz)
 	}
 
 	uopz_handlers_shutdown();
-	uopz_executors_shutdown();
+
+	if (!UOPZ(observer)) {
+		uopz_executors_shutdown();
+	}
 
 	return SUCCESS;
 } /* }}} */
@@ -102,9 +140,6 @@ static PHP_MSHUTDOWN_FUNCTION(uopz)
  */
 static PHP_RINIT_FUNCTION(uopz)
 {
-	zend_class_entry *ce = NULL;
-	zend_string *spl;
-
 #ifdef ZTS
 	ZEND_TSRMLS_CACHE_UPDATE();
 #endif
@@ -113,45 +148,50 @@ static PHP_RINIT_FUNCTION(uopz)
 		return SUCCESS;
 	}
 
-	if (INI_INT("opcache.optimization_level")) {
+	uopz_handlers_check();
 
-		zend_string *optimizer = zend_string_init(
-			ZEND_STRL("opcache.optimization_level"), 1);
+	/* the passes must be off before anything is compiled, so this cannot wait for activation */
+	if (INI_INT("opcache.optimization_level")) {
 		zend_long level = INI_INT("opcache.optimization_level");
-		zend_string *value;
 
-		/* must disable block pass 1 constant substitution */
-		level &= ~(1<<0);
-		
-		/* disable CFG optimization (exit optimized away here) */
-		level &= ~(1<<4);
+		if (UOPZ(feature_constants)) {
+			/* must disable block pass 1 constant substitution */
+			level &= ~(1<<0);
+		}
 
-		/* disable DCE (want code after exit) */
-		level &= ~(1<<13);
+		if (UOPZ(feature_functions)) {
+			/* disable call optimization (frame size is fixed at the call site) */
+			level &= ~(1<<3);
+		}
 
-		value = strpprintf(0, "0x%08X", (unsigned int) level);
+		if (UOPZ(intercept_exit)) {
+			/* disable CFG optimization (exit optimized away here) */
+			level &= ~(1<<4);
 
-		zend_alter_ini_entry(optimizer, value,
-			ZEND_INI_SYSTEM, ZEND_INI_STAGE_ACTIVATE);
+			/* disable DCE (want code after exit) */
+			level &= ~(1<<13);
+		}
 
-		/*zend_string_release(optimizer);*/
-		/*zend_string_release(value);*/
-	}
+		/* a configuration that already excludes the passes costs nothing */
+		if (level != INI_INT("opcache.optimization_level")) {
+			zend_string *optimizer = zend_string_init(
+				ZEND_STRL("opcache.optimization_level"), 1);
+			zend_string *value = strpprintf(0, "0x%08X", (unsigned int) level);
 
-	spl = zend_string_init(ZEND_STRL("RuntimeException"), 0);
-	spl_ce_RuntimeException =
-			(ce = zend_lookup_class(spl)) ?
-				ce : zend_exception_get_default();
-	/*zend_string_release(spl);*/
+			zend_alter_ini_entry(optimizer, value,
+				ZEND_INI_SYSTEM, ZEND_INI_STAGE_ACTIVATE);
 
-	spl = zend_string_init(ZEND_STRL("InvalidArgumentException"), 0);
-	spl_ce_InvalidArgumentException =
-			(ce = zend_lookup_class(spl)) ?
-				ce : zend_exception_get_default();
-	/*zend_string_release(spl);*/
+			zend_string_release(optimizer);
+			zend_string_release(value);
+		}
+	}
 
 	uopz_request_init();
 
+	if (!UOPZ(lazy)) {
+		uopz_request_activate();
+	}
+
 	return SUCCESS;
 } /* }}} */
 
@@ -169,6 +209,20 @@ static PHP_RSHUTDOWN_FUNCTION(uopz)
 }
 /* }}} */
 
+/* {{{ */
+static void php_uopz_stats(zval *stats) {
+	array_init(stats);
+
+	add_assoc_long(stats, "lookups",  UOPZ(stats).lookups);
+	add_assoc_long(stats, "hits",     UOPZ(stats).hits);
+	add_assoc_long(stats, "calls",    UOPZ(stats).calls);
+	add_assoc_long(stats, "closures", UOPZ(stats).closures);
+	add_assoc_long(stats, "mocks",    UOPZ(stats).mocks);
+	add_assoc_long(stats, "slots",    UOPZ(stats).slots);
+	add_assoc_long(stats, "patches",  UOPZ(patches));
+	add_assoc_long(stats, "time",     UOPZ(stats).time);
+} /* }}} */
+
 /* {{{ PHP_MINFO_FUNCTION
  */
 static PHP_MINFO_FUNCTION(uopz)
@@ -178,6 +232,27 @@ static PHP_MINFO_FUNCTION(uopz)
 	php_info_print_table_row(2, "Version", PHP_UOPZ_VERSION);
 	php_info_print_table_end();
 
+	if (!UOPZ(disable)) {
+		zval stats;
+		zend_string *name;
+		zval *value;
+
+		php_uopz_stats(&stats);
+
+		php_info_print_table_start();
+		php_info_print_table_header(2, "uopz statistics", "this request");
+		ZEND_HASH_FOREACH_STR_KEY_VAL(Z_ARRVAL(stats), name, value) {
+			char buffer[32];
+
+			snprintf(buffer, sizeof(buffer), ZEND_LONG_FMT, Z_LVAL_P(value));
+
+			php_info_print_table_row(2, ZSTR_VAL(name), buffer);
+		} ZEND_HASH_FOREACH_END();
+		php_info_print_table_end();
+
+		zval_ptr_dtor(&stats);
+	}
+
  	DISPLAY_INI_ENTRIES();
 }
 /* }}} */
@@ -190,8 +265,10 @@ static PHP_FUNCTION(uopz_set_return)
 	zval *variable = NULL;
 	zend_class_entry *clazz = NULL;
 	zend_bool execute = 0;
+	zend_long mark;
 
 	uopz_disabled_guard();
+	uopz_feature_guard(feature_functions, "uopz.functions");
 
 	if (uopz_parse_parameters("CSz|b", &clazz, &function, &variable, &execute) != SUCCESS &&
 		uopz_parse_parameters("Sz|b", &function, &variable, &execute) != SUCCESS) {
@@ -212,7 +289,11 @@ static PHP_FUNCTION(uopz_set_return)
 		return;
 	}
 
-	RETURN_BOOL(uopz_set_return(clazz, function, variable, execute));
+	mark = uopz_journal_mark();
+	uopz_journal_return(clazz, function);
+
+	RETURN_BOOL(uopz_journal_commit(mark, 
+		uopz_set_return(clazz, function, variable, execute)));
 } /* }}} */
 
 /* {{{ proto bool uopz_unset_return(string class, string function)
@@ -221,6 +302,7 @@ static PHP_FUNCTION(uopz_unset_return)
 {
 	zend_string *function = NULL;
 	zend_class_entry *clazz = NULL;
+	zend_long mark;
 
 	uopz_disabled_guard();
 
@@ -231,7 +313,11 @@ static PHP_FUNCTION(uopz_unset_return)
 		return;
 	}
 
-	RETURN_BOOL(uopz_unset_return(clazz, function));
+	mark = uopz_journal_mark();
+	uopz_journal_return(clazz, function);
+
+	RETURN_BOOL(uopz_journal_commit(mark, 
+		uopz_unset_return(clazz, function)));
 } /* }}} */
 
 /* {{{ proto mixed uopz_get_return(string class, string function)
@@ -253,17 +339,20 @@ static PHP_FUNCTION(uopz_get_return)
 	uopz_get_return(clazz, function, return_value);
 } /* }}} */
 
-/* {{{ proto void uopz_set_mock(string class, mixed mock) */
+/* {{{ proto void uopz_set_mock(string class, mixed mock [, bool statics = false]) */
 static PHP_FUNCTION(uopz_set_mock) 
 {
 	zend_string *clazz = NULL;
 	zval *mock = NULL;
+	zend_bool statics = 0;
+	zend_long mark;
 
 	uopz_disabled_guard();
+	uopz_observer_guard();
 
-	if (uopz_parse_parameters("Sz", &clazz, &mock) != SUCCESS) {
+	if (uopz_parse_parameters("Sz|b", &clazz, &mock, &statics) != SUCCESS) {
 		uopz_refuse_parameters(
-			"unexpected parameter combination, expected (class, mock), classes not found ?");
+			"unexpected parameter combination, expected (class, mock [, statics]), classes not found ?");
 		return;
 	}
 
@@ -273,13 +362,19 @@ static PHP_FUNCTION(uopz_set_mock)
 		return;
 	}
 
-	uopz_set_mock(clazz, mock);
+	mark = uopz_journal_mark();
+	uopz_journal_mock(clazz);
+
+	uopz_set_mock(clazz, mock, statics);
+
+	uopz_journal_commit(mark, 1);
 } /* }}} */
 
 /* {{{ proto void uopz_unset_mock(string mock) */
 static PHP_FUNCTION(uopz_unset_mock) 
 {
 	zend_string *clazz = NULL;
+	zend_long mark;
 
 	uopz_disabled_guard();
 
@@ -289,7 +384,12 @@ static PHP_FUNCTION(uopz_unset_mock)
 		return;
 	}
 
+	mark = uopz_journal_mark();
+	uopz_journal_mock(clazz);
+
 	uopz_unset_mock(clazz);
+
+	uopz_journal_commit(mark, 1);
 } /* }}} */
 
 /* {{{ proto void uopz_get_mock(string mock) */
@@ -334,6 +434,7 @@ static PHP_FUNCTION(uopz_set_static)
 	zend_string *function = NULL;
 	zend_class_entry *clazz = NULL;
 	zval *statics = NULL;
+	zend_long mark;
 
 	uopz_disabled_guard();
 
@@ -344,7 +445,11 @@ static PHP_FUNCTION(uopz_set_static)
 		return;
 	}
 
-	uopz_set_static(clazz, function, statics);
+	mark = uopz_journal_mark();
+	uopz_journal_statics(clazz, function);
+
+	uopz_journal_commit(mark, 
+		uopz_set_static(clazz, function, statics));
 } /* }}} */
 
 /* {{{ proto bool uopz_set_hook(string class, string function, Closure hook)
@@ -354,8 +459,10 @@ static PHP_FUNCTION(uopz_set_hook)
 	zend_string *function = NULL;
 	zend_class_entry *clazz = NULL;
 	zval *hook = NULL;
+	zend_long mark;
 
 	uopz_disabled_guard();
+	uopz_feature_guard(feature_functions, "uopz.functions");
 	
 	if (uopz_parse_parameters("CSO", &clazz, &function, &hook, zend_ce_closure) != SUCCESS &&
 		uopz_parse_parameters("SO", &function, &hook, zend_ce_closure) != SUCCESS) {
@@ -364,7 +471,11 @@ static PHP_FUNCTION(uopz_set_hook)
 		return;
 	}
 
-	RETURN_BOOL(uopz_set_hook(clazz, function, hook));
+	mark = uopz_journal_mark();
+	uopz_journal_hook(clazz, function);
+
+	RETURN_BOOL(uopz_journal_commit(mark, 
+		uopz_set_hook(clazz, function, hook)));
 } /* }}} */
 
 /* {{{ proto bool uopz_unset_hook(string class, string function)
@@ -373,6 +484,7 @@ static PHP_FUNCTION(uopz_unset_hook)
 {
 	zend_string *function = NULL;
 	zend_class_entry *clazz = NULL;
+	zend_long mark;
 
 	uopz_disabled_guard();
 
@@ -383,7 +495,11 @@ static PHP_FUNCTION(uopz_unset_hook)
 		return;
 	}
 
-	RETURN_BOOL(uopz_unset_hook(clazz, function));
+	mark = uopz_journal_mark();
+	uopz_journal_hook(clazz, function);
+
+	RETURN_BOOL(uopz_journal_commit(mark, 
+		uopz_unset_hook(clazz, function)));
 } /* }}} */
 
 /* {{{ proto Closure uopz_get_hook(string class, string function)
@@ -414,8 +530,10 @@ static PHP_FUNCTION(uopz_add_function)
 	zval *closure = NULL;
 	zend_long flags = ZEND_ACC_PUBLIC;
 	zend_bool all = 1;
+	zend_long mark;
 
 	uopz_disabled_guard();
+	uopz_feature_guard(feature_functions, "uopz.functions");
 
 	if (uopz_parse_parameters("CSO|lb", &clazz, &name, &closure, zend_ce_closure, &flags, &all) != SUCCESS &&
 		uopz_parse_parameters("SO|l", &name, &closure, zend_ce_closure, &flags) != SUCCESS) {
@@ -424,7 +542,11 @@ static PHP_FUNCTION(uopz_add_function)
 		return;
 	}
 
-	RETURN_BOOL(uopz_add_function(clazz, name, closure, flags, all));
+	mark = uopz_journal_mark();
+	uopz_journal_add_function(clazz, name, all);
+
+	RETURN_BOOL(uopz_journal_commit(mark, 
+		uopz_add_function(clazz, name, closure, flags, all)));
 } /* }}} */
 
 /* {{{ proto bool uopz_del_function(string class, string method [, bool all = false])
@@ -434,8 +556,11 @@ static PHP_FUNCTION(uopz_del_function)
 	zend_class_entry *clazz = NULL;
 	zend_string *name = NULL;
 	zend_bool all = 1;
+	zend_long mark;
 
 	uopz_disabled_guard();
+	uopz_feature_guard(feature_functions, "uopz.functions");
+	uopz_observer_guard();
 
 	if (uopz_parse_parameters("CS|b", &clazz, &name, &all) != SUCCESS &&
 		uopz_parse_parameters("S", &name) != SUCCESS) {
@@ -444,7 +569,62 @@ static PHP_FUNCTION(uopz_del_function)
 		return;
 	}
 
-	RETURN_BOOL(uopz_del_function(clazz, name, all));
+	mark = uopz_journal_mark();
+	uopz_journal_del_function(clazz, name, all);
+
+	RETURN_BOOL(uopz_journal_commit(mark, 
+		uopz_del_function(clazz, name, all)));
+} /* }}} */
+
+/* {{{ proto bool uopz_replace_function(string class, string method, Closure body)
+			 bool uopz_replace_function(string function, Closure body) */
+static PHP_FUNCTION(uopz_replace_function)
+{
+	zend_class_entry *clazz = NULL;
+	zend_string *name = NULL;
+	zval *closure = NULL;
+	zend_long mark;
+
+	uopz_disabled_guard();
+	uopz_feature_guard(feature_functions, "uopz.functions");
+
+	if (uopz_parse_parameters("CSO", &clazz, &name, &closure, zend_ce_closure) != SUCCESS &&
+		uopz_parse_parameters("SO", &name, &closure, zend_ce_closure) != SUCCESS) {
+		uopz_refuse_parameters(
+			"unexpected parameter combination, expected (class, function, closure) or (function, closure)");
+		return;
+	}
+
+	mark = uopz_journal_mark();
+	uopz_journal_replacement(clazz, name);
+
+	RETURN_BOOL(uopz_journal_commit(mark, 
+		uopz_replace_function(clazz, name, closure)));
+} /* }}} */
+
+/* {{{ proto bool uopz_restore_function(string class, string method)
+			 bool uopz_restore_function(string function) */
+static PHP_FUNCTION(uopz_restore_function)
+{
+	zend_class_entry *clazz = NULL;
+	zend_string *name = NULL;
+	zend_long mark;
+
+	uopz_disabled_guard();
+	uopz_feature_guard(feature_functions, "uopz.functions");
+
+	if (uopz_parse_parameters("CS", &clazz, &name) != SUCCESS &&
+		uopz_parse_parameters("S", &name) != SUCCESS) {
+		uopz_refuse_parameters(
+			"unexpected parameter combination, expected (class, function) or (function)");
+		return;
+	}
+
+	mark = uopz_journal_mark();
+	uopz_journal_replacement(clazz, name);
+
+	RETURN_BOOL(uopz_journal_commit(mark, 
+		uopz_restore_function(clazz, name)));
 } /* }}} */
 
 /* {{{ proto bool uopz_redefine(string constant, mixed variable)
@@ -454,8 +634,10 @@ static PHP_FUNCTION(uopz_redefine)
 	zend_string *name = NULL;
 	zval *variable = NULL;
 	zend_class_entry *clazz = NULL;
+	zend_long mark;
 
 	uopz_disabled_guard();
+	uopz_feature_guard(feature_constants, "uopz.constants");
 
 	if (uopz_parse_parameters("CSz", &clazz, &name, &variable) != SUCCESS &&
 		uopz_parse_parameters("Sz", &name, &variable) != SUCCESS) {
@@ -464,9 +646,17 @@ static PHP_FUNCTION(uopz_redefine)
 		return;
 	}
 
-	if (uopz_constant_redefine(clazz, name, variable)) {
+	if (clazz) {
+		uopz_observer_guard();
+	}
+
+	mark = uopz_journal_mark();
+	uopz_journal_constant(clazz, name);
+
+	if (uopz_journal_commit(mark, uopz_constant_redefine(clazz, name, variable))) {
 		if (clazz) {
 			while ((clazz = clazz->parent)) {
+				uopz_journal_constant(clazz, name);
 				uopz_constant_redefine(
 					clazz, name, variable);
 			}
@@ -483,8 +673,11 @@ static PHP_FUNCTION(uopz_undefine)
 {
 	zend_string *name = NULL;
 	zend_class_entry *clazz = NULL;
+	zend_long mark;
 
 	uopz_disabled_guard();
+	uopz_feature_guard(feature_constants, "uopz.constants");
+	uopz_observer_guard();
 
 	if (uopz_parse_parameters("CS", &clazz, &name) != SUCCESS &&
 		uopz_parse_parameters("S", &name) != SUCCESS) {
@@ -493,9 +686,13 @@ static PHP_FUNCTION(uopz_undefine)
 		return;
 	}
 
-	if (uopz_constant_undefine(clazz, name)) {
+	mark = uopz_journal_mark();
+	uopz_journal_constant(clazz, name);
+
+	if (uopz_journal_commit(mark, uopz_constant_undefine(clazz, name))) {
 		if (clazz) {
 			while ((clazz = clazz->parent)) {
+				uopz_journal_constant(clazz, name);
 				uopz_constant_undefine(clazz, name);
 			}
 		}
@@ -558,6 +755,10 @@ static PHP_FUNCTION(uopz_flags)
 	}	
 
 	uopz_flags(clazz, name, flags, return_value);
+
+	if (flags != ZEND_LONG_MAX && !EG(exception) && Z_TYPE_P(return_value) == IS_LONG) {
+		uopz_journal_flags(clazz, name, Z_LVAL_P(return_value));
+	}
 } /* }}} */
 
 /* {{{ proto void uopz_set_property(object instance, string property, mixed value) 
@@ -567,6 +768,7 @@ static PHP_FUNCTION(uopz_set_property)
 	zval *scope = NULL;
 	zval *prop  = NULL;
 	zval *value = NULL;
+	zend_long mark;
 
 	uopz_disabled_guard();
 
@@ -580,7 +782,10 @@ static PHP_FUNCTION(uopz_set_property)
 		return;
 	}
 
+	mark = uopz_journal_mark();
+
 	if (Z_TYPE_P(scope) == IS_OBJECT) {
+		uopz_journal_property(scope, NULL, Z_STR_P(prop));
 		uopz_set_property(scope, prop, value);
 	} else {
 		zend_class_entry *ce = zend_lookup_class(Z_STR_P(scope));
@@ -589,8 +794,11 @@ static PHP_FUNCTION(uopz_set_property)
 			return;
 		}
 
+		uopz_journal_property(NULL, ce, Z_STR_P(prop));
 		uopz_set_static_property(ce, Z_STR_P(prop), value);
 	}
+
+	uopz_journal_commit(mark, 1);
 } /* }}} */
 
 /* {{{ proto mixed uopz_get_property(object instance, string property) 
@@ -628,6 +836,7 @@ static PHP_FUNCTION(uopz_get_property) {
 static PHP_FUNCTION(uopz_get_exit_status) {
 
 	uopz_disabled_guard();
+	uopz_feature_guard(intercept_exit, "uopz.intercept_exit");
 
 	if (Z_TYPE(UOPZ(estatus)) != IS_UNDEF) {
 		ZVAL_COPY(return_value, &UOPZ(estatus));
@@ -639,6 +848,7 @@ static PHP_FUNCTION(uopz_allow_exit) {
 	zend_bool allow = 0;
 
 	uopz_disabled_guard();
+	uopz_feature_guard(intercept_exit, "uopz.intercept_exit");
 	
 	if (uopz_parse_parameters("b", &allow) != SUCCESS) {
 		uopz_refuse_parameters(
@@ -646,9 +856,350 @@ static PHP_FUNCTION(uopz_allow_exit) {
 		return;
 	}
 
+	uopz_journal_exit();
+
 	UOPZ(exit) = allow;
 } /* }}} */
 
+/* {{{ proto int uopz_snapshot(void) */
+static PHP_FUNCTION(uopz_snapshot) {
+
+	uopz_disabled_guard();
+
+	if (zend_parse_parameters_none() != SUCCESS) {
+		return;
+	}
+
+	RETURN_LONG(uopz_journal_snapshot());
+} /* }}} */
+
+/* {{{ proto bool uopz_restore(int snapshot) */
+static PHP_FUNCTION(uopz_restore) {
+	zend_long snapshot = 0;
+	zend_bool restored;
+
+	uopz_disabled_guard();
+
+	if (uopz_parse_parameters("l", &snapshot) != SUCCESS) {
+		uopz_refuse_parameters(
+			"unexpected parameter combination, expected (snapshot)");
+		return;
+	}
+
+	if (!uopz_journal_outstanding(snapshot)) {
+		uopz_refuse_parameters(
+			"snapshot " ZEND_LONG_FMT " was not taken in this request, or was already restored", snapshot);
+		return;
+	}
+
+	restored = uopz_journal_rewind(snapshot);
+
+	uopz_journal_release(snapshot);
+
+	RETURN_BOOL(restored);
+} /* }}} */
+
+typedef struct _uopz_apply_op_t {
+	const char *name;
+	const char *scoped;
+	const char *plain;
+} uopz_apply_op_t;
+
+/* {{{ the mutations uopz_apply accepts, named without the uopz_ prefix, with the arguments
+	of their class form and of their plain form: C class, S string, O closure, o object,
+	b and l scalars, z anything, optional after | */
+static const uopz_apply_op_t uopz_apply_ops[] = {
+	{"set_return",       "CSz|b",  "Sz|b"},
+	{"unset_return",     "CS",     "S"},
+	{"set_hook",         "CSO",    "SO"},
+	{"unset_hook",       "CS",     "S"},
+	{"set_mock",         NULL,     "Sz|b"},
+	{"unset_mock",       NULL,     "S"},
+	{"add_function",     "CSO|lb", "SO|l"},
+	{"del_function",     "CS|b",   "S"},
+	{"replace_function", "CSO",    "SO"},
+	{"restore_function", "CS",     "S"},
+	{"redefine",         "CSz",    "Sz"},
+	{"undefine",         "CS",     "S"},
+	{"set_static",       "CSz",    "Sz"},
+	{"set_property",     "CSz",    "oSz"},
+	{"flags",            "CS|l",   "S|l"},
+	{NULL,               NULL,     NULL}
+}; /* }}} */
+
+#define UOPZ_APPLY_ARGS 8
+
+static const uopz_apply_op_t* uopz_apply_entry(zval *op) { /* {{{ */
+	const uopz_apply_op_t *entry = uopz_apply_ops;
+	zval *first;
+
+	if (Z_TYPE_P(op) != IS_ARRAY ||
+		!(first = zend_hash_index_find(Z_ARRVAL_P(op), 0)) ||
+		Z_TYPE_P(first) != IS_STRING) {
+		return NULL;
+	}
+
+	while (entry->name) {
+		if (strcmp(Z_STRVAL_P(first), entry->name) == 0) {
+			return entry;
+		}
+		entry++;
+	}
+
+	return NULL;
+} /* }}} */
+
+static zend_string* uopz_apply_name(zval *op) { /* {{{ */
+	if (!uopz_apply_entry(op)) {
+		return NULL;
+	}
+
+	return Z_STR_P(zend_hash_index_find(Z_ARRVAL_P(op), 0));
+} /* }}} */
+
+/* {{{ the arguments of an operation, the elements after its name, NULL when there are too many */
+static zval** uopz_apply_args(zval *op, zval **args, uint32_t *count) {
+	zval *arg;
+	zend_bool first = 1;
+
+	*count = 0;
+
+	ZEND_HASH_FOREACH_VAL(Z_ARRVAL_P(op), arg) {
+		if (first) {
+			first = 0;
+			continue;
+		}
+
+		if (*count == UOPZ_APPLY_ARGS) {
+			return NULL;
+		}
+
+		args[(*count)++] = arg;
+	} ZEND_HASH_FOREACH_END();
+
+	return args;
+} /* }}} */
+
+/* {{{ matches arguments against a form without converting them or loading classes */
+static zend_bool uopz_apply_shape(const char *spec, zval **args, uint32_t count) {
+	uint32_t position = 0;
+	zend_bool optional = 0;
+
+	if (!spec) {
+		return 0;
+	}
+
+	for (; *spec; spec++) {
+		zval *arg;
+
+		if (*spec == '|') {
+			optional = 1;
+			continue;
+		}
+
+		if (position == count) {
+			return optional;
+		}
+
+		arg = args[position++];
+
+		ZVAL_DEREF(arg);
+
+		switch (*spec) {
+			case 'C':
+			case 'S':
+				if (Z_TYPE_P(arg) != IS_STRING) {
+					return 0;
+				}
+			break;
+
+			case 'O':
+				if (Z_TYPE_P(arg) != IS_OBJECT ||
+					!instanceof_function(Z_OBJCE_P(arg), zend_ce_closure)) {
+					return 0;
+				}
+			break;
+
+			case 'o':
+				if (Z_TYPE_P(arg) != IS_OBJECT) {
+					return 0;
+				}
+			break;
+
+			case 'b':
+			case 'l':
+				if (Z_TYPE_P(arg) < IS_NULL || Z_TYPE_P(arg) > IS_STRING) {
+					return 0;
+				}
+			break;
+		}
+	}
+
+	return position == count;
+} /* }}} */
+
+/* {{{ 1 when an operation is in its class form, 0 in its plain form, -1 when its arguments fit neither */
+static int uopz_apply_form(zval *op) {
+	const uopz_apply_op_t *entry = uopz_apply_entry(op);
+	zval *args[UOPZ_APPLY_ARGS];
+	uint32_t count;
+
+	if (!entry || !uopz_apply_args(op, args, &count)) {
+		return -1;
+	}
+
+	if (uopz_apply_shape(entry->scoped, args, count)) {
+		return 1;
+	}
+
+	return uopz_apply_shape(entry->plain, args, count) ? 0 : -1;
+} /* }}} */
+
+/* {{{ the class an operation in its class form names is loaded before the batch begins,
+	autoloaders must not run within it */
+static zend_bool uopz_apply_resolve(zval *op) {
+	zval *args[UOPZ_APPLY_ARGS], *scope;
+	uint32_t count;
+
+	if (uopz_apply_form(op) != 1) {
+		return 1;
+	}
+
+	uopz_apply_args(op, args, &count);
+
+	scope = args[0];
+
+	ZVAL_DEREF(scope);
+
+	zend_lookup_class(Z_STR_P(scope));
+
+	return !EG(exception);
+} /* }}} */
+
+/* {{{ an operation is the API function it names, called with the rest of its elements */
+static zend_bool uopz_apply_op(zval *op) {
+	zend_fcall_info fci = empty_fcall_info;
+	zval retval, *arg, *params;
+	uint32_t count = 0;
+	zend_bool result, first = 1;
+
+	params = safe_emalloc(zend_hash_num_elements(Z_ARRVAL_P(op)), sizeof(zval), 0);
+
+	ZEND_HASH_FOREACH_VAL(Z_ARRVAL_P(op), arg) {
+		if (first) {
+			first = 0;
+			continue;
+		}
+
+		ZVAL_COPY_VALUE(&params[count++], arg);
+	} ZEND_HASH_FOREACH_END();
+
+	ZVAL_UNDEF(&retval);
+	ZVAL_STR(&fci.function_name, 
+		strpprintf(0, "uopz_%s", ZSTR_VAL(uopz_apply_name(op))));
+
+	fci.size = sizeof(zend_fcall_info);
+#if PHP_VERSION_ID < 80000
+	fci.no_separation = 1;
+#endif
+	fci.params = params;
+	fci.param_count = count;
+	fci.retval = &retval;
+
+	result = zend_call_function(&fci, NULL) == SUCCESS &&
+			!EG(exception) && Z_TYPE(retval) != IS_FALSE;
+
+	zval_ptr_dtor(&retval);
+	zval_ptr_dtor(&fci.function_name);
+	efree(params);
+
+	return result;
+} /* }}} */
+
+/* {{{ proto bool uopz_apply(array operations) */
+static PHP_FUNCTION(uopz_apply) {
+	HashTable *ops = NULL;
+	zval *op;
+	zend_long index = 0,
+			  snapshot;
+	zend_bool applied = 1;
+
+	uopz_disabled_guard();
+
+	if (uopz_parse_parameters("h", &ops) != SUCCESS) {
+		uopz_refuse_parameters(
+			"unexpected parameter combination, expected (operations)");
+		return;
+	}
+
+	ZEND_HASH_FOREACH_VAL(ops, op) {
+		if (!uopz_apply_name(op)) {
+			uopz_refuse_parameters(
+				"operation " ZEND_LONG_FMT " is not supported, expected [name, ...arguments]", index);
+			return;
+		}
+
+		if (uopz_apply_form(op) < 0) {
+			uopz_refuse_parameters(
+				"operation " ZEND_LONG_FMT " (%s) has unexpected arguments", 
+				index, ZSTR_VAL(uopz_apply_name(op)));
+			return;
+		}
+		index++;
+	} ZEND_HASH_FOREACH_END();
+
+	ZEND_HASH_FOREACH_VAL(ops, op) {
+		if (!uopz_apply_resolve(op)) {
+			RETURN_FALSE;
+		}
+	} ZEND_HASH_FOREACH_END();
+
+	/* the batch is recorded as a snapshot of its own, so a failure can be undone */
+	snapshot = uopz_journal_snapshot();
+	index = 0;
+
+	uopz_batch_begin();
+
+	ZEND_HASH_FOREACH_VAL(ops, op) {
+		if (!uopz_apply_op(op)) {
+			applied = 0;
+			break;
+		}
+		index++;
+	} ZEND_HASH_FOREACH_END();
+
+	if (!applied) {
+		if (!EG(exception)) {
+			uopz_exception(
+				"operation " ZEND_LONG_FMT " (%s) failed", 
+				index, ZSTR_VAL(uopz_apply_name(op)));
+		}
+
+		/* the failure is reported once everything before it is undone */
+		zend_exception_save();
+		uopz_journal_rewind(snapshot);
+		zend_exception_restore();
+	}
+
+	uopz_journal_release(snapshot);
+
+	uopz_batch_end();
+
+	RETURN_BOOL(applied);
+} /* }}} */
+
+/* {{{ proto array uopz_stats(void) */
+static PHP_FUNCTION(uopz_stats) {
+
+	uopz_disabled_guard();
+
+	if (zend_parse_parameters_none() != SUCCESS) {
+		return;
+	}
+
+	php_uopz_stats(return_value);
+} /* }}} */
+
 /* {{{ uopz_functions[]
  */
 #if PHP_VERSION_ID >= 80000
@@ -678,6 +1229,8 @@ static const zend_function_entry uopz_functions[] = {
 	UOPZ_FE(uopz_unset_hook)
 	UOPZ_FE(uopz_add_function)
 	UOPZ_FE(uopz_del_function)
+	UOPZ_FE(uopz_replace_function)
+	UOPZ_FE(uopz_restore_function)
 	UOPZ_FE(uopz_extend)
 	UOPZ_FE(uopz_implement)
 	UOPZ_FE(uopz_flags)
@@ -687,6 +1240,10 @@ static const zend_function_entry uopz_functions[] = {
 	UOPZ_FE(uopz_get_property)
 	UOPZ_FE_NOARGS(uopz_get_exit_status)
 	UOPZ_FE(uopz_allow_exit)
+	UOPZ_FE_NOARGS(uopz_snapshot)
+	UOPZ_FE(uopz_restore)
+	UOPZ_FE(uopz_apply)
+	UOPZ_FE_NOARGS(uopz_stats)
 
 	UOPZ_FE(uopz_call_user_func)
 	UOPZ_FE(uopz_call_user_func_array)
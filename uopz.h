@@ -25,17 +25,63 @@ extern zend_module_entry uopz_module_entry;
 #define PHP_UOPZ_VERSION "6.1.2"
 #define PHP_UOPZ_EXTNAME "uopz"
 
+#include "php_uopz.h"
+
+/* counters for the current request, reported by uopz_stats and phpinfo */
+typedef struct _uopz_stats_t {
+	zend_long lookups;
+	zend_long hits;
+	zend_long calls;
+	zend_long closures;
+	zend_long mocks;
+	zend_long slots;
+	zend_long time;
+} uopz_stats_t;
+
 ZEND_BEGIN_MODULE_GLOBALS(uopz)
 	zend_long	copts;
 
 	HashTable   functions;
+	HashTable   dirty;
+	HashTable   journal;
+	zend_long   journaled;
+	HashTable   snapshots;
+	zend_long   snapshotted;
 	HashTable	returns;
 	HashTable	mocks;
+	HashTable	mcache;
+	zend_bool   statics;
 	HashTable   hooks;
+	HashTable   replacements;
+	HashTable   internals;
+
+	zend_long   intercepts;
+	zend_long   patches;
+	HashTable   rcache;
+	HashTable   hcache;
+
+	zend_long   generation;
+	zend_long   batch;
+	zend_bool   batched;
+	HashTable   stamps;
+
+	HashTable   constants;
 
 	zend_bool	exit;
 	zval 		estatus;
 	zend_bool   disable;
+	zend_bool   lazy;
+	zend_bool   active;
+
+	zend_bool   feature_constants;
+	zend_bool   feature_functions;
+	zend_bool   intercept_exit;
+	zend_bool   observer;
+	zend_bool   specialize;
+	HashTable   sites;
+
+	uopz_stats_t stats;
+	zend_bool   stats_time;
 ZEND_END_MODULE_GLOBALS(uopz)
 
 #ifdef ZTS
@@ -52,6 +98,8 @@ ZEND_END_MODULE_GLOBALS(uopz)
 #define uopz_exception(message, ...) zend_throw_exception_ex\
 	(spl_ce_RuntimeException, 0, message, ##__VA_ARGS__)
 
+#define UOPZ_STAT(s) (UOPZ(stats).s++)
+
 #endif	/* UOPZ_H */
 
 /*